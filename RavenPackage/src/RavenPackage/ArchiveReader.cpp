@@ -0,0 +1,1186 @@
+#include "ArchiveReader.h"
+#include "Format.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_set>
+
+// Decoded solid blocks kept per reader, spread over two shards
+#ifndef RPK_SOLID_BLOCK_CACHE_BLOCKS
+#define RPK_SOLID_BLOCK_CACHE_BLOCKS 8
+#endif
+#define RPK_SOLID_BLOCK_CACHE_SHARDS 2
+
+namespace rvn {
+	// Decoded chunks are read into copy buffers
+	static_assert(RPK_COPY_BUFFER_SIZE >= RPK_COMPRESSION_CHUNK_SIZE, "Copy buffers have to hold a whole chunk");
+
+	int ArchiveReader::open(const std::string& archPath)
+	{
+		close();
+		if (!std::filesystem::exists(archPath)) {
+			RPK_ERROR("Input doesnt exist");
+			return RPK_ARCHIVE_DOESNT_EXIST;
+		}
+		else if (std::filesystem::is_directory(archPath)) {
+			RPK_ERROR("Input cant be a directory");
+			return RPK_INPUT_IS_DIRECTORY;
+		}
+		if (!_file->openRead(archPath)) {
+			RPK_ERROR("Couln't open input");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		std::string buffer(RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH, 0x00);
+		if (_file->readAt(0, &buffer[0], buffer.length()) != buffer.length()
+			|| buffer.compare(0, RPK_MAGIC_NUMBER_LENGTH, RPK_MAGIC_NUMBER) != 0) {
+			RPK_ERROR("Input is no Raven Package");
+			close();
+			return RPK_INPUT_ISNT_RAVEN_PACKAGE;
+		}
+		_version = (std::uint8_t)buffer.back();
+		if (std::find(supportedExtractVersions.begin(), supportedExtractVersions.end(), _version)
+			== supportedExtractVersions.end()) {
+			RPK_ERROR("Unsupported file version");
+			close();
+			return RPK_UNSUPPORTED_VERSION;
+		}
+		int status = RPK_OK;
+		switch (_version) {
+		case RPK_VERSION_1:
+			status = loadV1();
+			if (status == RPK_OK) {
+				buildSlots();
+				buildTotals(true);
+			}
+			break;
+		case RPK_VERSION_2:
+			status = loadV2();
+			break;
+		}
+		if (status != RPK_OK) {
+			RPK_ERROR("Archive index is corrupt");
+			close();
+			return status;
+		}
+		_archPath = archPath;
+		return RPK_OK;
+	}
+	void ArchiveReader::close()
+	{
+		// Streams handed out before keep the old handle open
+		_file = std::make_shared<platform::File>();
+		_archPath.clear();
+		_version = 0;
+		_entries.clear();
+		_children.clear();
+		_paths.clear();
+		_slots.clear();
+		_directoryLength = 0;
+		_alignment = 0;
+		_alignmentThreshold = 0;
+		_blocks.clear();
+		_blockCache.reset();
+		_deletions.clear();
+		// Views handed out before keep their own reference to the mapping
+		std::atomic_store(&_mapping, std::shared_ptr<const platform::MappedFile>());
+		std::atomic_store(&_unbufferedFile, std::shared_ptr<const platform::File>());
+		std::atomic_store(&_pathOrder, std::shared_ptr<const std::vector<std::uint32_t>>());
+		if (_cache) _cache->clear();
+	}
+	int ArchiveReader::loadV1()
+	{
+		const std::uint64_t fileSize = _file->getSize();
+		_entries.emplace_back();
+		struct PendingDirectory {
+			std::uint32_t index;
+			std::uint64_t begin;
+		};
+		std::vector<PendingDirectory> pending = { { 0, RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH } };
+		std::unordered_set<std::uint64_t> visited;
+		std::string table;
+		while (!pending.empty()) {
+			PendingDirectory dir = pending.back();
+			pending.pop_back();
+			if (!visited.insert(dir.begin).second) return RPK_CORRUPT_ARCHIVE;
+			char countBytes[RPK_V1_FILE_COUNT_LENGTH];
+			if (_file->readAt(dir.begin, countBytes, RPK_V1_FILE_COUNT_LENGTH) != RPK_V1_FILE_COUNT_LENGTH) return RPK_CORRUPT_ARCHIVE;
+			std::uint16_t count = package::util::convertCharsToUint16(countBytes);
+			// A header table is at most count * (header + 255 name bytes) long, so it can be read at once
+			std::uint64_t tableBegin = dir.begin + RPK_V1_FILE_COUNT_LENGTH;
+			std::uint64_t tableLength = std::min<std::uint64_t>((std::uint64_t)count * (RPK_V1_FILE_HEADER_LENGTH + 255), fileSize - tableBegin);
+			table.resize((std::size_t)tableLength);
+			if (_file->readAt(tableBegin, &table[0], table.length()) != table.length()) return RPK_CORRUPT_ARCHIVE;
+
+			_entries[dir.index].firstChild = (std::uint32_t)_children.size();
+			_entries[dir.index].childCount = count;
+			std::size_t pos = 0;
+			for (std::uint16_t i = 0; i < count; i++) {
+				if (pos + 2 > table.length()) return RPK_CORRUPT_ARCHIVE;
+				std::uint8_t traits = (std::uint8_t)table[pos];
+				std::uint8_t nameLength = (std::uint8_t)table[pos + 1];
+				bool isFile = traits & RPK_TRAIT_IS_FILE;
+				std::size_t headerLength = isFile ? RPK_V1_FILE_HEADER_LENGTH : RPK_V1_DIR_HEADER_LENGTH;
+				if (pos + headerLength + nameLength > table.length()) return RPK_CORRUPT_ARCHIVE;
+				pos += 2;
+				if (!format::isSafeName(std::string_view(&table[pos], nameLength))) {
+					RPK_ERROR("Archive contains an unsafe path");
+					return RPK_INVALID_PATH;
+				}
+				std::uint32_t index = addEntry(dir.index, &table[pos], nameLength, isFile ? RPK_TRAIT_IS_FILE : 0);
+				pos += nameLength;
+				_children.push_back(index);
+				IndexEntry& entry = _entries[index];
+				entry.begin = package::util::convertCharsToUint64(&table[pos]);
+				pos += 8;
+				if (isFile) {
+					entry.end = package::util::convertCharsToUint64(&table[pos]);
+					pos += 8;
+					if (entry.begin > entry.end || entry.end > fileSize) return RPK_CORRUPT_ARCHIVE;
+					entry.length = entry.end - entry.begin;
+				}
+				else {
+					// Sub directories always follow the table of their parent
+					if (entry.begin < tableBegin + pos || entry.begin >= fileSize) return RPK_CORRUPT_ARCHIVE;
+					pending.push_back({ index, entry.begin });
+					entry.begin = 0;
+				}
+			}
+		}
+		return RPK_OK;
+	}
+	int ArchiveReader::loadV2()
+	{
+		const std::uint64_t fileSize = _file->getSize();
+		const std::uint64_t headerLength = RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH;
+		if (fileSize < headerLength + RPK_V2_FOOTER_LENGTH) return RPK_CORRUPT_ARCHIVE;
+		std::string buffer(RPK_V2_FOOTER_LENGTH, 0x00);
+		if (_file->readAt(fileSize - RPK_V2_FOOTER_LENGTH, &buffer[0], buffer.length()) != buffer.length()
+			|| buffer.compare(RPK_V2_FOOTER_LENGTH - RPK_V2_FOOTER_MAGIC.length(), RPK_V2_FOOTER_MAGIC.length(), RPK_V2_FOOTER_MAGIC) != 0)
+			return RPK_CORRUPT_ARCHIVE;
+		const std::uint64_t dirOffset = format::readUint64(&buffer[0]);
+		const std::uint64_t dirLength = format::readUint64(&buffer[8]);
+		const std::uint64_t dirChecksum = format::readUint64(&buffer[16]);
+		if (dirOffset < headerLength || dirLength < RPK_V2_DIRECTORY_HEADER_LENGTH
+			|| dirOffset > fileSize - RPK_V2_FOOTER_LENGTH || dirLength != fileSize - RPK_V2_FOOTER_LENGTH - dirOffset)
+			return RPK_CORRUPT_ARCHIVE;
+
+		_directoryLength = dirLength;
+		// The whole central directory is read with a single call
+		std::string dir((std::size_t)dirLength, 0x00);
+		if (_file->readAt(dirOffset, &dir[0], dir.length()) != dir.length()) return RPK_CORRUPT_ARCHIVE;
+		if ((dirChecksum & RPK_V2_FOOTER_HAS_CHECKSUM) && (std::uint32_t)dirChecksum != crc32c(0, dir.data(), dir.length())) {
+			RPK_ERROR("Central directory checksum doesn't match");
+			return RPK_CHECKSUM_MISMATCH;
+		}
+		const std::uint32_t flags = format::readUint32(&dir[0]);
+		const std::uint32_t count = format::readUint32(&dir[4]);
+		const std::uint32_t slotCount = format::readUint32(&dir[8]);
+		if (flags & ~(RPK_V2_FLAG_ALIGNED | RPK_V2_FLAG_SOLID | RPK_V2_FLAG_DELETIONS)) return RPK_UNSUPPORTED_VERSION;
+		if (count >= UINT32_MAX - 1 || slotCount <= count || (slotCount & (slotCount - 1)) != 0) return RPK_CORRUPT_ARCHIVE;
+		std::size_t pos = RPK_V2_DIRECTORY_HEADER_LENGTH;
+		if (flags & RPK_V2_FLAG_ALIGNED) {
+			if (pos + RPK_V2_ALIGNMENT_HEADER_LENGTH > dir.length()) return RPK_CORRUPT_ARCHIVE;
+			_alignment = format::readUint32(&dir[pos]);
+			_alignmentThreshold = format::readUint64(&dir[pos + 4]);
+			if (_alignment < 2 || (_alignment & (_alignment - 1)) != 0) return RPK_CORRUPT_ARCHIVE;
+			pos += RPK_V2_ALIGNMENT_HEADER_LENGTH;
+		}
+		if (flags & RPK_V2_FLAG_SOLID) {
+			if (pos + 4 > dir.length()) return RPK_CORRUPT_ARCHIVE;
+			const std::uint32_t blockCount = format::readUint32(&dir[pos]);
+			pos += 4;
+			if ((dir.length() - pos) / RPK_V2_BLOCK_LENGTH < blockCount) return RPK_CORRUPT_ARCHIVE;
+			_blocks.resize(blockCount);
+			std::uint64_t largest = 1;
+			for (auto& block : _blocks) {
+				block.traits = (std::uint8_t)dir[pos];
+				block.begin = format::readUint64(&dir[pos + 1]);
+				block.end = format::readUint64(&dir[pos + 9]);
+				block.codec = (std::uint8_t)dir[pos + 17];
+				block.length = format::readUint64(&dir[pos + 18]);
+				block.checksum = format::readUint32(&dir[pos + 26]);
+				pos += RPK_V2_BLOCK_LENGTH;
+				if (block.traits & ~RPK_TRAIT_CHECKSUM) return RPK_UNSUPPORTED_VERSION;
+				if (block.begin < headerLength || block.begin > block.end || block.end > dirOffset || block.length > RPK_V2_MAX_SOLID_BLOCK_SIZE
+					|| (block.codec == RPK_CODEC_NONE && block.length != block.end - block.begin))
+					return RPK_CORRUPT_ARCHIVE;
+				largest = std::max(largest, block.length);
+			}
+			if (!_blocks.empty()) _blockCache = std::make_unique<EntryCache>((std::size_t)largest * RPK_SOLID_BLOCK_CACHE_BLOCKS, RPK_SOLID_BLOCK_CACHE_SHARDS);
+		}
+		if (flags & RPK_V2_FLAG_DELETIONS) {
+			if (pos + 4 > dir.length()) return RPK_CORRUPT_ARCHIVE;
+			const std::uint32_t deletionCount = format::readUint32(&dir[pos]);
+			pos += 4;
+			if ((dir.length() - pos) / 2 < deletionCount) return RPK_CORRUPT_ARCHIVE;
+			_deletions.reserve(deletionCount);
+			for (std::uint32_t i = 0; i < deletionCount; i++) {
+				if (pos + 2 > dir.length()) return RPK_CORRUPT_ARCHIVE;
+				const std::uint16_t pathLength = format::readUint16(&dir[pos]);
+				pos += 2;
+				if (pathLength == 0 || pos + pathLength > dir.length()) return RPK_CORRUPT_ARCHIVE;
+				_deletions.push_back(format::normalizePath(dir.substr(pos, pathLength)));
+				if (!format::isSafePath(_deletions.back())) {
+					RPK_ERROR("Archive contains an unsafe path");
+					return RPK_INVALID_PATH;
+				}
+				pos += pathLength;
+			}
+		}
+
+		_entries.reserve((std::size_t)count + 1);
+		_entries.emplace_back();
+		std::vector<std::uint32_t> childCounts((std::size_t)count + 1, 0);
+		bool missingTotals = false;
+		for (std::uint32_t i = 0; i < count; i++) {
+			if (pos + RPK_V2_ENTRY_HEADER_LENGTH > dir.length()) return RPK_CORRUPT_ARCHIVE;
+			const std::size_t recordEnd = pos + 2 + format::readUint16(&dir[pos]);
+			IndexEntry entry;
+			entry.traits = (std::uint8_t)dir[pos + 2];
+			std::uint32_t parent = format::readUint32(&dir[pos + 3]);
+			const std::uint16_t pathLength = format::readUint16(&dir[pos + 7]);
+			pos += 9;
+			if (recordEnd > dir.length() || pos + pathLength + 16 > recordEnd) return RPK_CORRUPT_ARCHIVE;
+			if (entry.traits & ~(RPK_TRAIT_IS_FILE | RPK_TRAIT_COMPRESSED | RPK_TRAIT_CHECKSUM | RPK_TRAIT_SOLID | RPK_TRAIT_TOTALS))
+				return RPK_UNSUPPORTED_VERSION;
+			// Writers only store normalized paths, anything else could be extracted outside of the target directory
+			if (!format::isSafePath(std::string_view(&dir[pos], pathLength))) {
+				RPK_ERROR("Archive contains an unsafe path");
+				return RPK_INVALID_PATH;
+			}
+			// Parents always come before their children
+			entry.parent = parent == RPK_V2_NO_PARENT ? 0 : parent + 1;
+			if (entry.parent > i || (entry.parent && _entries[entry.parent].isFile())) return RPK_CORRUPT_ARCHIVE;
+			std::uint16_t nameStart = pathLength;
+			while (nameStart > 0 && dir[pos + nameStart - 1] != '/') nameStart--;
+			entry.pathOffset = (std::uint32_t)_paths.length();
+			entry.pathLength = pathLength;
+			entry.nameOffset = entry.pathOffset + nameStart;
+			_paths.append(&dir[pos], pathLength);
+			pos += pathLength;
+			entry.begin = format::readUint64(&dir[pos]);
+			entry.end = format::readUint64(&dir[pos + 8]);
+			if (entry.isFile() && (entry.begin > entry.end || (!(entry.traits & RPK_TRAIT_SOLID) && (entry.begin < headerLength || entry.end > dirOffset))))
+				return RPK_CORRUPT_ARCHIVE;
+			entry.length = entry.end - entry.begin;
+			pos += 16;
+			if (entry.traits & RPK_TRAIT_COMPRESSED) {
+				if (pos + 9 > recordEnd || !entry.isFile()) return RPK_CORRUPT_ARCHIVE;
+				entry.codec = (std::uint8_t)dir[pos];
+				entry.length = format::readUint64(&dir[pos + 1]);
+				pos += 9;
+			}
+			if (entry.traits & RPK_TRAIT_CHECKSUM) {
+				if (pos + 4 > recordEnd || !entry.isFile()) return RPK_CORRUPT_ARCHIVE;
+				entry.checksum = format::readUint32(&dir[pos]);
+				pos += 4;
+			}
+			if (entry.traits & RPK_TRAIT_SOLID) {
+				// The block has the codec and checksum, the file only knows where it is inside
+				if (pos + 4 > recordEnd || !entry.isFile() || (entry.traits & (RPK_TRAIT_COMPRESSED | RPK_TRAIT_CHECKSUM))) return RPK_CORRUPT_ARCHIVE;
+				entry.block = format::readUint32(&dir[pos]);
+				pos += 4;
+				if (entry.block >= _blocks.size() || entry.end > _blocks[entry.block].length) return RPK_CORRUPT_ARCHIVE;
+				const format::Block& block = _blocks[entry.block];
+				entry.offset = entry.begin;
+				entry.begin = block.begin;
+				entry.end = block.end;
+				entry.codec = block.codec;
+				entry.checksum = block.checksum;
+				entry.traits |= block.traits & RPK_TRAIT_CHECKSUM;
+			}
+			if (entry.traits & RPK_TRAIT_TOTALS) {
+				if (pos + 16 > recordEnd || entry.isFile()) return RPK_CORRUPT_ARCHIVE;
+				entry.fileCount = format::readUint64(&dir[pos]);
+				entry.length = format::readUint64(&dir[pos + 8]);
+				pos += 16;
+			}
+			else if (!entry.isFile()) {
+				// Archives written before directory totals existed
+				missingTotals = true;
+			}
+			pos = recordEnd;
+			childCounts[entry.parent]++;
+			_entries.push_back(entry);
+		}
+
+		// Children of a directory are stored next to each other
+		std::uint32_t next = 0;
+		for (std::size_t i = 0; i < _entries.size(); i++) {
+			_entries[i].firstChild = next;
+			next += childCounts[i];
+		}
+		_children.resize(next);
+		for (std::uint32_t i = 1; i < (std::uint32_t)_entries.size(); i++) {
+			IndexEntry& parent = _entries[_entries[i].parent];
+			_children[parent.firstChild + parent.childCount++] = i;
+		}
+
+		if (pos + (std::uint64_t)slotCount * RPK_V2_SLOT_LENGTH != dir.length()) return RPK_CORRUPT_ARCHIVE;
+		_slots.resize(slotCount);
+		for (auto& slot : _slots) {
+			slot.hash = format::readUint64(&dir[pos]);
+			std::uint32_t index = format::readUint32(&dir[pos + 8]);
+			if (index != RPK_V2_EMPTY_SLOT && index >= count) return RPK_CORRUPT_ARCHIVE;
+			// Entry 0 is the root, which isn't stored in the archive
+			slot.index = index == RPK_V2_EMPTY_SLOT ? UINT32_MAX : index + 1;
+			pos += RPK_V2_SLOT_LENGTH;
+		}
+		buildTotals(missingTotals);
+		return RPK_OK;
+	}
+	void ArchiveReader::buildTotals(bool recompute)
+	{
+		for (auto& entry : _entries) {
+			if (recompute && !entry.isFile()) {
+				entry.fileCount = 0;
+				entry.length = 0;
+			}
+		}
+		// The root isn't stored, so its totals are always added up from its children
+		_entries[0].fileCount = 0;
+		_entries[0].length = 0;
+		// Children come after their parents, so walking backwards finishes every directory before its parent
+		for (std::size_t i = _entries.size(); i-- > 1;) {
+			const IndexEntry& entry = _entries[i];
+			if (!recompute && entry.parent != 0) continue;
+			IndexEntry& parent = _entries[entry.parent];
+			parent.fileCount += entry.isFile() ? 1 : entry.fileCount;
+			parent.length += entry.length;
+		}
+	}
+	std::uint32_t ArchiveReader::addEntry(std::uint32_t parent, const char* name, std::size_t nameLength, std::uint8_t traits)
+	{
+		IndexEntry entry;
+		entry.parent = parent;
+		entry.traits = traits;
+		const IndexEntry& parentEntry = _entries[parent];
+		std::size_t offset = _paths.length();
+		std::size_t prefix = parentEntry.pathLength ? parentEntry.pathLength + 1 : 0;
+		_paths.resize(offset + prefix + nameLength);
+		if (prefix) {
+			std::memcpy(&_paths[offset], &_paths[parentEntry.pathOffset], parentEntry.pathLength);
+			_paths[offset + prefix - 1] = '/';
+		}
+		std::memcpy(&_paths[offset + prefix], name, nameLength);
+		entry.pathOffset = (std::uint32_t)offset;
+		entry.pathLength = (std::uint32_t)(prefix + nameLength);
+		entry.nameOffset = (std::uint32_t)(offset + prefix);
+		_entries.push_back(entry);
+		return (std::uint32_t)(_entries.size() - 1);
+	}
+	void ArchiveReader::buildSlots()
+	{
+		const std::size_t slotCount = format::getSlotCount(_entries.size());
+		_slots.assign(slotCount, Slot());
+		const std::size_t mask = slotCount - 1;
+		for (std::uint32_t i = 1; i < (std::uint32_t)_entries.size(); i++) {
+			const IndexEntry& entry = _entries[i];
+			const char* path = &_paths[entry.pathOffset];
+			std::uint64_t hash = format::hashPath(path, entry.pathLength);
+			std::size_t slot = hash & mask;
+			bool duplicate = false;
+			while (_slots[slot].index != UINT32_MAX) {
+				const IndexEntry& other = _entries[_slots[slot].index];
+				if (_slots[slot].hash == hash && other.pathLength == entry.pathLength
+					&& std::memcmp(&_paths[other.pathOffset], path, entry.pathLength) == 0) {
+					// First entry with a path wins, just like the old linear scan
+					duplicate = true;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+			if (!duplicate) _slots[slot] = { hash, i };
+		}
+	}
+	std::uint32_t ArchiveReader::find(const std::string& filePath) const
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Lookup);
+		if (_entries.empty()) return UINT32_MAX;
+		std::string path = format::normalizePath(filePath);
+		if (path.empty()) return 0;
+		std::uint64_t hash = format::hashPath(path.data(), path.length());
+		const std::size_t mask = _slots.size() - 1;
+		for (std::size_t slot = hash & mask; _slots[slot].index != UINT32_MAX; slot = (slot + 1) & mask) {
+			metrics::add(metrics::Counter::IndexProbes);
+			if (_slots[slot].hash != hash) continue;
+			const IndexEntry& entry = _entries[_slots[slot].index];
+			if (entry.pathLength == path.length() && std::memcmp(&_paths[entry.pathOffset], path.data(), path.length()) == 0)
+				return _slots[slot].index;
+		}
+		return UINT32_MAX;
+	}
+	void ArchiveReader::recordAccess(std::uint32_t index) const
+	{
+		if (!_trace || !_trace->recording) return;
+		std::string path = getEntryPath(_entries[index]);
+		std::lock_guard<std::mutex> lock(_trace->mutex);
+		if (_trace->seen.insert(path).second) _trace->paths.push_back(std::move(path));
+	}
+	void ArchiveReader::setAccessTracing(bool enabled)
+	{
+		if (enabled) _trace = std::make_unique<AccessTrace>();
+		else if (_trace) _trace->recording = false;
+	}
+	std::vector<std::string> ArchiveReader::getAccessTrace() const
+	{
+		if (!_trace) return {};
+		std::lock_guard<std::mutex> lock(_trace->mutex);
+		return _trace->paths;
+	}
+	int ArchiveReader::writeAccessTrace(const std::string& tracePath) const
+	{
+		std::ofstream out(tracePath, std::ios::binary);
+		if (!out) {
+			RPK_ERROR("Couldn't open output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		for (auto& path : getAccessTrace()) out << path << '\n';
+		if (!out) {
+			RPK_ERROR("Couldn't write output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		return RPK_OK;
+	}
+	bool ArchiveReader::exists(const std::string& filePath) const
+	{
+		return find(filePath) != UINT32_MAX;
+	}
+	std::uint64_t ArchiveReader::getStaleBytes() const
+	{
+		if (_version != RPK_VERSION_2) return 0;
+		// Copies of deduplicated files share their range, so ranges are only counted once
+		std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+		for (auto& entry : _entries) {
+			if (entry.isFile() && entry.end > entry.begin) ranges.push_back({ entry.begin, entry.end });
+		}
+		std::sort(ranges.begin(), ranges.end());
+		std::uint64_t used = RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH + _directoryLength + RPK_V2_FOOTER_LENGTH;
+		std::uint64_t covered = RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH;
+		for (auto& range : ranges) {
+			// Padding in front of an aligned payload is part of the layout
+			if (_alignment > 1 && range.first > covered && range.first - covered < _alignment && range.first % _alignment == 0)
+				used += range.first - covered;
+			std::uint64_t begin = std::max(range.first, covered);
+			if (range.second > begin) used += range.second - begin;
+			covered = std::max(covered, range.second);
+		}
+		return _file->getSize() > used ? _file->getSize() - used : 0;
+	}
+	void ArchiveReader::getRecords(std::vector<format::Record>& records, std::vector<format::Block>& blocks) const
+	{
+		blocks = _blocks;
+		records.clear();
+		records.reserve(getEntryCount());
+		for (std::size_t i = 1; i < _entries.size(); i++) {
+			const IndexEntry& entry = _entries[i];
+			format::Record record;
+			record.path = getEntryPath(entry);
+			record.parent = entry.parent == 0 ? RPK_V2_NO_PARENT : entry.parent - 1;
+			record.traits = entry.traits;
+			record.begin = entry.begin;
+			record.end = entry.end;
+			record.codec = entry.codec;
+			record.length = entry.length;
+			record.checksum = entry.checksum;
+			if (entry.isSolid()) {
+				record.traits &= ~RPK_TRAIT_CHECKSUM;
+				record.begin = entry.offset;
+				record.end = entry.offset + entry.length;
+				record.codec = RPK_CODEC_NONE;
+				record.checksum = 0;
+				record.block = entry.block;
+			}
+			records.push_back(record);
+		}
+	}
+	Entry ArchiveReader::makeEntry(const IndexEntry& indexEntry) const
+	{
+		Entry entry;
+		entry.name = getEntryName(indexEntry);
+		entry.isFile = indexEntry.isFile();
+		entry.length = (std::size_t)indexEntry.length;
+		entry.formattedLength = package::util::formatBytes(entry.length);
+		if (!entry.isFile) {
+			entry.childCount = indexEntry.childCount;
+			entry.fileCount = (std::size_t)indexEntry.fileCount;
+			entry.hasSubFiles = indexEntry.childCount > 0;
+		}
+		return entry;
+	}
+	int ArchiveReader::readEntry(const IndexEntry& entry, char* dst) const
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Read);
+		if (!entry.isSolid()) return readPayload(entry, dst);
+		std::shared_ptr<const std::string> block;
+		int status = getBlock(entry, block);
+		if (status == RPK_OK) std::memcpy(dst, block->data() + entry.offset, (std::size_t)entry.length);
+		return status;
+	}
+	int ArchiveReader::readPayload(const IndexEntry& entry, char* dst) const
+	{
+		if (entry.isSolid()) {
+			// The entry already carries the range and checksum of its block
+			IndexEntry block = entry;
+			block.block = RPK_V2_NO_BLOCK;
+			block.length = _blocks[entry.block].length;
+			return readPayload(block, dst);
+		}
+		std::size_t stored = (std::size_t)(entry.end - entry.begin);
+		if (entry.codec == RPK_CODEC_NONE) {
+			if (_file->readAt(entry.begin, dst, stored) != stored) {
+				RPK_ERROR("Couldn't read file from archive");
+				return RPK_CORRUPT_ARCHIVE;
+			}
+			return needsChecksum(entry) ? checkPayload(entry, crc32c(0, dst, stored)) : RPK_OK;
+		}
+		if (entry.codec != RPK_CODEC_LZ4) {
+			RPK_ERROR("Unsupported codec");
+			return RPK_UNSUPPORTED_CODEC;
+		}
+		std::string buffer(stored, 0x00);
+		if (_file->readAt(entry.begin, &buffer[0], stored) != stored) {
+			RPK_ERROR("Couldn't read file from archive");
+			return RPK_CORRUPT_ARCHIVE;
+		}
+		// Checked before decoding, so the decoder never sees damaged input
+		if (needsChecksum(entry)) {
+			int status = checkPayload(entry, crc32c(0, buffer.data(), stored));
+			if (status != RPK_OK) return status;
+		}
+		if (!compression::decodePayload(buffer.data(), stored, dst, (std::size_t)entry.length)) {
+			RPK_ERROR("Couldn't decompress file from archive");
+			return RPK_CORRUPT_ARCHIVE;
+		}
+		return RPK_OK;
+	}
+	int ArchiveReader::getBlock(const IndexEntry& entry, std::shared_ptr<const std::string>& data) const
+	{
+		data = _blockCache->get(entry.block);
+		if (data) return RPK_OK;
+		// Threads missing the same block at once both decode it, the first one is kept
+		auto decoded = std::make_shared<std::string>((std::size_t)_blocks[entry.block].length, 0x00);
+		int status = readPayload(entry, &(*decoded)[0]);
+		if (status != RPK_OK) return status;
+		data = std::move(decoded);
+		_blockCache->put(entry.block, data);
+		return RPK_OK;
+	}
+	int ArchiveReader::checkPayload(const IndexEntry& entry, std::uint32_t crc) const
+	{
+		if (!needsChecksum(entry) || crc == entry.checksum) return RPK_OK;
+		RPK_ERROR("Checksum of '" + getEntryPath(entry) + "' doesn't match");
+		return RPK_CHECKSUM_MISMATCH;
+	}
+	int ArchiveReader::writeEntry(const IndexEntry& entry, const std::string& targetPath, platform::Buffer& buffer) const
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Read);
+		if (std::filesystem::exists(targetPath)) {
+			RPK_ERROR("Target already exists");
+			return RPK_OUTPUT_EXISTS;
+		}
+		// A new file of our own, an existing file with the same name is never opened
+		std::string tempPath;
+		platform::File out;
+		if (!out.openTemp(targetPath, tempPath)) {
+			RPK_ERROR("Couldn't open output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		int status = writePayload(entry, out, buffer);
+		// Closed before renaming or removing it, Windows can't do either with an open handle
+		out.close();
+		if (status == RPK_OK) {
+			// Something created in the meantime is kept, the check above is only a shortcut
+			if (platform::renameNoReplace(tempPath, targetPath)) return RPK_OK;
+			if (std::filesystem::exists(targetPath)) {
+				RPK_ERROR("Target already exists");
+				status = RPK_OUTPUT_EXISTS;
+			}
+			else {
+				RPK_ERROR("Couldn't rename '" + tempPath + "' to '" + targetPath + "'");
+				status = RPK_COULDNT_OPEN_FILE;
+			}
+		}
+		std::error_code error;
+		std::filesystem::remove(tempPath, error);
+		return status;
+	}
+	int ArchiveReader::writePayload(const IndexEntry& entry, const platform::File& out, platform::Buffer& buffer) const
+	{
+		if (entry.isSolid()) {
+			std::shared_ptr<const std::string> block;
+			int status = getBlock(entry, block);
+			if (status != RPK_OK) return status;
+			if (!out.writeAt(0, block->data() + entry.offset, (std::size_t)entry.length)) {
+				RPK_ERROR("Couldn't write output file");
+				return RPK_COULDNT_OPEN_FILE;
+			}
+			return RPK_OK;
+		}
+		const bool check = needsChecksum(entry);
+		if (entry.codec == RPK_CODEC_NONE && !check) {
+			if (!_file->copyTo(entry.begin, out, 0, entry.end - entry.begin, buffer)) {
+				RPK_ERROR("Couldn't copy file from archive");
+				return RPK_CORRUPT_ARCHIVE;
+			}
+			return RPK_OK;
+		}
+		std::uint32_t crc = 0;
+		if (entry.codec == RPK_CODEC_NONE) {
+			// Goes through the buffer so the checksum is computed on the way
+			for (std::uint64_t done = 0; done < entry.length;) {
+				std::size_t length = (std::size_t)std::min<std::uint64_t>(buffer.getLength(), entry.length - done);
+				if (_file->readAt(entry.begin + done, buffer.getData(), length) != length) {
+					RPK_ERROR("Couldn't copy file from archive");
+					return RPK_CORRUPT_ARCHIVE;
+				}
+				crc = crc32c(crc, buffer.getData(), length);
+				if (!out.writeAt(done, buffer.getData(), length)) {
+					RPK_ERROR("Couldn't write output file");
+					return RPK_COULDNT_OPEN_FILE;
+				}
+				done += length;
+			}
+			return checkPayload(entry, crc);
+		}
+		if (entry.codec != RPK_CODEC_LZ4) {
+			RPK_ERROR("Unsupported codec");
+			return RPK_UNSUPPORTED_CODEC;
+		}
+		// One chunk at a time, so memory stays bounded for large files
+		std::string chunk;
+		std::uint64_t pos = entry.begin;
+		for (std::uint64_t done = 0; done < entry.length;) {
+			char header[RPK_COMPRESSION_CHUNK_HEADER_LENGTH];
+			std::size_t length = (std::size_t)std::min<std::uint64_t>(RPK_COMPRESSION_CHUNK_SIZE, entry.length - done);
+			if (entry.end - pos < RPK_COMPRESSION_CHUNK_HEADER_LENGTH
+				|| _file->readAt(pos, header, RPK_COMPRESSION_CHUNK_HEADER_LENGTH) != RPK_COMPRESSION_CHUNK_HEADER_LENGTH) {
+				RPK_ERROR("Couldn't read file from archive");
+				return RPK_CORRUPT_ARCHIVE;
+			}
+			std::uint32_t stored = format::readUint32(header) & ~RPK_COMPRESSION_CHUNK_STORED;
+			pos += RPK_COMPRESSION_CHUNK_HEADER_LENGTH;
+			chunk.resize(RPK_COMPRESSION_CHUNK_HEADER_LENGTH + stored);
+			std::memcpy(&chunk[0], header, RPK_COMPRESSION_CHUNK_HEADER_LENGTH);
+			if (entry.end - pos < stored || _file->readAt(pos, &chunk[RPK_COMPRESSION_CHUNK_HEADER_LENGTH], stored) != stored) {
+				RPK_ERROR("Couldn't read file from archive");
+				return RPK_CORRUPT_ARCHIVE;
+			}
+			if (check) {
+				crc = crc32c(crc, chunk.data(), chunk.length());
+				// The last chunk completes the checksum before it is decoded
+				if (pos + stored == entry.end) {
+					int status = checkPayload(entry, crc);
+					if (status != RPK_OK) return status;
+				}
+			}
+			if (!compression::decodePayload(chunk.data(), chunk.length(), buffer.getData(), length)) {
+				RPK_ERROR("Couldn't decompress file from archive");
+				return RPK_CORRUPT_ARCHIVE;
+			}
+			if (!out.writeAt(done, buffer.getData(), length)) {
+				RPK_ERROR("Couldn't write output file");
+				return RPK_COULDNT_OPEN_FILE;
+			}
+			pos += stored;
+			done += length;
+		}
+		if (check && pos != entry.end) {
+			RPK_ERROR("Checksum of '" + getEntryPath(entry) + "' doesn't match");
+			return RPK_CHECKSUM_MISMATCH;
+		}
+		return RPK_OK;
+	}
+	int ArchiveReader::extractFile(const std::string& filePath, const std::string& targetPath) const
+	{
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			return RPK_INVALID_PATH;
+		}
+		recordAccess(index);
+		platform::Buffer buffer;
+		return writeEntry(_entries[index], targetPath, buffer);
+	}
+	int ArchiveReader::extractFile(const std::string& filePath) const
+	{
+		return extractFile(filePath, std::filesystem::path(filePath).filename().string());
+	}
+	std::pair<int, std::shared_ptr<std::string>> ArchiveReader::extractToString(const std::string& filePath) const
+	{
+		std::pair<int, std::shared_ptr<std::string>> ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			ret.first = RPK_INVALID_PATH;
+			return ret;
+		}
+		recordAccess(index);
+		const IndexEntry& entry = _entries[index];
+		if (_cache) {
+			// The caller may modify its string, so it gets a copy of the shared buffer
+			std::shared_ptr<const std::string> shared;
+			ret.first = readShared(index, shared);
+			if (ret.first == RPK_OK) ret.second = std::make_shared<std::string>(*shared);
+			return ret;
+		}
+		auto data = std::make_shared<std::string>((std::size_t)entry.length, 0x00);
+		ret.first = readEntry(entry, &(*data)[0]);
+		if (ret.first == RPK_OK) ret.second = data;
+		return ret;
+	}
+	std::pair<int, std::shared_ptr<const std::string>> ArchiveReader::getShared(const std::string& filePath) const
+	{
+		std::pair<int, std::shared_ptr<const std::string>> ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			ret.first = RPK_INVALID_PATH;
+			return ret;
+		}
+		recordAccess(index);
+		ret.first = readShared(index, ret.second);
+		return ret;
+	}
+	int ArchiveReader::readShared(std::uint32_t index, std::shared_ptr<const std::string>& data) const
+	{
+		if (_cache) {
+			data = _cache->get(index);
+			if (data) return RPK_OK;
+		}
+		const IndexEntry& entry = _entries[index];
+		auto read = std::make_shared<std::string>((std::size_t)entry.length, 0x00);
+		int status = readEntry(entry, &(*read)[0]);
+		if (status != RPK_OK) return status;
+		data = std::move(read);
+		if (_cache) _cache->put(index, data);
+		return RPK_OK;
+	}
+	void ArchiveReader::setCacheBudget(std::size_t byteBudget)
+	{
+		if (byteBudget == 0) _cache.reset();
+		else _cache = std::make_unique<EntryCache>(byteBudget);
+	}
+	CacheStats ArchiveReader::getCacheStats() const
+	{
+		return _cache ? _cache->getStats() : CacheStats();
+	}
+	Entries ArchiveReader::getEntriesAt(const std::string& filePath) const
+	{
+		Entries ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || _entries[index].isFile()) {
+			RPK_ERROR("Directory doesn't exist in archive");
+			ret.status = RPK_INVALID_PATH;
+			return ret;
+		}
+		const IndexEntry& dir = _entries[index];
+		ret.entries.reserve(dir.childCount);
+		for (std::uint32_t i = 0; i < dir.childCount; i++) {
+			ret.entries.push_back(makeEntry(_entries[_children[dir.firstChild + i]]));
+		}
+		return ret;
+	}
+	std::pair<int, Entry> ArchiveReader::getEntry(const std::string& filePath) const
+	{
+		std::pair<int, Entry> ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX) {
+			RPK_ERROR("Path doesn't exist in archive");
+			ret.first = RPK_INVALID_PATH;
+			return ret;
+		}
+		ret.first = RPK_OK;
+		ret.second = makeEntry(_entries[index]);
+		return ret;
+	}
+	std::shared_ptr<const platform::MappedFile> ArchiveReader::getMapping() const
+	{
+		std::shared_ptr<const platform::MappedFile> mapping = std::atomic_load(&_mapping);
+		if (mapping) return mapping;
+		auto created = std::make_shared<platform::MappedFile>();
+		if (!created->map(*_file)) {
+			RPK_ERROR("Couldn't map archive");
+			return nullptr;
+		}
+		// Another thread might have been faster, in that case its mapping is used
+		mapping = created;
+		std::shared_ptr<const platform::MappedFile> expected;
+		if (!std::atomic_compare_exchange_strong(&_mapping, &expected, mapping)) return expected;
+		return mapping;
+	}
+	std::shared_ptr<const std::vector<std::uint32_t>> ArchiveReader::getPathOrder() const
+	{
+		std::shared_ptr<const std::vector<std::uint32_t>> order = std::atomic_load(&_pathOrder);
+		if (order) return order;
+		auto created = std::make_shared<std::vector<std::uint32_t>>();
+		created->reserve(getEntryCount());
+		for (std::uint32_t i = 1; i < _entries.size(); i++) created->push_back(i);
+		auto less = [this](std::uint32_t a, std::uint32_t b) {
+			const std::string_view paths(_paths);
+			return paths.substr(_entries[a].pathOffset, _entries[a].pathLength) < paths.substr(_entries[b].pathOffset, _entries[b].pathLength);
+		};
+		// Version 2 writers store the entries sorted, version 1 and older version 2 archives are sorted here
+		if (!std::is_sorted(created->begin(), created->end(), less)) std::stable_sort(created->begin(), created->end(), less);
+		order = created;
+		std::shared_ptr<const std::vector<std::uint32_t>> expected;
+		if (!std::atomic_compare_exchange_strong(&_pathOrder, &expected, order)) return expected;
+		return order;
+	}
+	PathQuery ArchiveReader::makeQuery(std::string prefix, std::string pattern, bool glob) const
+	{
+		PathQuery ret;
+		if (_entries.empty()) return ret;
+		ret._reader = this;
+		ret._order = getPathOrder();
+		const std::string_view paths(_paths);
+		auto first = std::lower_bound(ret._order->begin(), ret._order->end(), prefix, [&](std::uint32_t index, const std::string& value) {
+			return paths.substr(_entries[index].pathOffset, _entries[index].pathLength) < value;
+		});
+		ret._first = (std::size_t)(first - ret._order->begin());
+		ret._prefix = std::move(prefix);
+		ret._pattern = std::move(pattern);
+		ret._glob = glob;
+		return ret;
+	}
+	PathQuery ArchiveReader::queryPrefix(const std::string& prefix) const
+	{
+		std::string normalized = format::normalizePath(prefix);
+		// "dir/" only finds what is below dir, not dir itself or "dir2"
+		if (!normalized.empty() && (prefix.back() == '/' || prefix.back() == '\\')) normalized.push_back('/');
+		return makeQuery(std::move(normalized), "", false);
+	}
+	PathQuery ArchiveReader::query(const std::string& pattern) const
+	{
+		std::string normalized = format::normalizePath(pattern);
+		std::string prefix = normalized.substr(0, normalized.find_first_of("*?"));
+		return makeQuery(std::move(prefix), std::move(normalized), true);
+	}
+	EntryView ArchiveReader::view(const std::string& filePath) const
+	{
+		EntryView ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			ret.status = RPK_INVALID_PATH;
+			return ret;
+		}
+		recordAccess(index);
+		const IndexEntry& entry = _entries[index];
+		if (entry.isSolid()) {
+			// Points into the decoded block, which the view keeps alive
+			std::shared_ptr<const std::string> block;
+			ret.status = getBlock(entry, block);
+			if (ret.status == RPK_OK) {
+				ret.data = std::string_view(block->data() + entry.offset, (std::size_t)entry.length);
+				ret.owner = std::move(block);
+			}
+			return ret;
+		}
+		if (entry.codec != RPK_CODEC_NONE) {
+			// Compressed files can't be viewed in place, the view owns a decompressed copy
+			auto data = std::make_shared<std::string>((std::size_t)entry.length, 0x00);
+			ret.status = readEntry(entry, &(*data)[0]);
+			if (ret.status == RPK_OK) {
+				ret.data = *data;
+				ret.owner = data;
+			}
+			return ret;
+		}
+		std::shared_ptr<const platform::MappedFile> mapping = getMapping();
+		if (!mapping) {
+			ret.status = RPK_COULDNT_OPEN_FILE;
+			return ret;
+		}
+		ret.data = std::string_view(mapping->getData() + entry.begin, (std::size_t)(entry.end - entry.begin));
+		ret.owner = mapping;
+		return ret;
+	}
+	std::shared_ptr<const platform::File> ArchiveReader::getUnbufferedFile() const
+	{
+		std::shared_ptr<const platform::File> file = std::atomic_load(&_unbufferedFile);
+		if (file) return file;
+		// A handle that failed to open is kept too, so unsupported file systems are only tried once
+		auto created = std::make_shared<platform::File>();
+		created->openRead(_archPath, true);
+		file = created;
+		std::shared_ptr<const platform::File> expected;
+		if (!std::atomic_compare_exchange_strong(&_unbufferedFile, &expected, file)) return expected;
+		return file;
+	}
+	EntryView ArchiveReader::readUnbuffered(const std::string& filePath) const
+	{
+		EntryView ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			ret.status = RPK_INVALID_PATH;
+			return ret;
+		}
+		recordAccess(index);
+		const IndexEntry& entry = _entries[index];
+		if (entry.length == 0) return ret;
+		const std::uint64_t mask = RPK_COPY_BUFFER_ALIGNMENT - 1;
+		if (entry.codec == RPK_CODEC_NONE && !entry.isSolid()) {
+			// Whole blocks around the payload, for aligned payloads that is nothing but the payload itself
+			const std::uint64_t start = entry.begin & ~mask;
+			const std::uint64_t stop = (entry.end + mask) & ~mask;
+			std::shared_ptr<const platform::File> file = getUnbufferedFile();
+			if (file->isOpen()) {
+				auto buffer = std::make_shared<platform::Buffer>((std::size_t)(stop - start));
+				if (file->readAt(start, buffer->getData(), buffer->getLength()) >= entry.end - start) {
+					ret.data = std::string_view(buffer->getData() + (entry.begin - start), (std::size_t)entry.length);
+					if (needsChecksum(entry)) ret.status = checkPayload(entry, crc32c(0, ret.data.data(), ret.data.length()));
+					if (ret.status != RPK_OK) ret.data = std::string_view();
+					else ret.owner = buffer;
+					return ret;
+				}
+			}
+		}
+		auto buffer = std::make_shared<platform::Buffer>((std::size_t)((entry.length + mask) & ~mask));
+		ret.status = readEntry(entry, buffer->getData());
+		if (ret.status == RPK_OK) {
+			ret.data = std::string_view(buffer->getData(), (std::size_t)entry.length);
+			ret.owner = buffer;
+		}
+		return ret;
+	}
+	EntryStream ArchiveReader::openStream(const std::string& filePath) const
+	{
+		EntryStream ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || !_entries[index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			ret._status = RPK_INVALID_PATH;
+			return ret;
+		}
+		recordAccess(index);
+		const IndexEntry& entry = _entries[index];
+		if (entry.isSolid()) {
+			// Small enough to be read from the decoded block
+			ret._status = getBlock(entry, ret._memory);
+			ret._begin = entry.offset;
+			ret._length = entry.length;
+			return ret;
+		}
+		ret._file = _file;
+		ret._begin = entry.begin;
+		ret._end = entry.end;
+		ret._length = entry.length;
+		ret._codec = entry.codec;
+		if (entry.codec != RPK_CODEC_NONE) {
+			if (entry.codec != RPK_CODEC_LZ4) {
+				RPK_ERROR("Unsupported codec");
+				ret._status = RPK_UNSUPPORTED_CODEC;
+				return ret;
+			}
+			// Chunk headers are walked once so every read can go straight to its chunk
+			std::uint64_t pos = entry.begin;
+			for (std::uint64_t done = 0; done < entry.length; done += RPK_COMPRESSION_CHUNK_SIZE) {
+				char header[RPK_COMPRESSION_CHUNK_HEADER_LENGTH];
+				if (entry.end - pos < RPK_COMPRESSION_CHUNK_HEADER_LENGTH
+					|| _file->readAt(pos, header, RPK_COMPRESSION_CHUNK_HEADER_LENGTH) != RPK_COMPRESSION_CHUNK_HEADER_LENGTH) {
+					RPK_ERROR("Couldn't read file from archive");
+					ret._status = RPK_CORRUPT_ARCHIVE;
+					return ret;
+				}
+				ret._chunks.push_back(pos);
+				pos += RPK_COMPRESSION_CHUNK_HEADER_LENGTH + (format::readUint32(header) & ~RPK_COMPRESSION_CHUNK_STORED);
+				if (pos > entry.end) {
+					RPK_ERROR("Couldn't read file from archive");
+					ret._status = RPK_CORRUPT_ARCHIVE;
+					return ret;
+				}
+			}
+			ret._chunks.push_back(pos);
+			ret._cache = std::make_shared<EntryStream::ChunkCache>();
+		}
+		ret._status = RPK_OK;
+		return ret;
+	}
+	// Joins an archive path onto targetDir, false if the result wouldn't be below targetDir
+	static bool joinTarget(const std::string& targetDir, const std::string& path, std::string& target)
+	{
+		if (!format::isSafePath(path)) return false;
+		const std::filesystem::path base = std::filesystem::path(targetDir.empty() ? "." : targetDir).lexically_normal();
+		const std::filesystem::path joined = (base / path).lexically_normal();
+		const std::filesystem::path relative = joined.lexically_relative(base);
+		if (relative.empty() || *relative.begin() == "..") return false;
+		target = joined.string();
+		return true;
+	}
+	std::vector<ExtractResult> ArchiveReader::extractMany(const std::vector<std::string>& filePaths, const std::string& targetDir, std::size_t threads) const
+	{
+		std::vector<ExtractResult> results(filePaths.size());
+		std::vector<std::uint32_t> indices(filePaths.size(), UINT32_MAX);
+		for (std::size_t i = 0; i < filePaths.size(); i++) {
+			results[i].path = filePaths[i];
+			std::uint32_t index = find(filePaths[i]);
+			if (index == UINT32_MAX || !_entries[index].isFile()) {
+				RPK_ERROR("File '" + filePaths[i] + "' doesn't exist in archive");
+				results[i].status = RPK_INVALID_PATH;
+				continue;
+			}
+			if (!joinTarget(targetDir, getEntryPath(_entries[index]), results[i].targetPath)) {
+				RPK_ERROR("'" + filePaths[i] + "' would be extracted outside of the target directory");
+				results[i].status = RPK_INVALID_PATH;
+				continue;
+			}
+			indices[i] = index;
+		}
+		extractEntries(indices, results, threads);
+		return results;
+	}
+	std::vector<ExtractResult> ArchiveReader::extractDirectory(const std::string& dirPath, const std::string& targetDir, std::size_t threads) const
+	{
+		std::vector<ExtractResult> results;
+		std::vector<std::uint32_t> indices;
+		std::uint32_t base = find(dirPath);
+		if (base == UINT32_MAX || _entries[base].isFile()) {
+			RPK_ERROR("Directory doesn't exist in archive");
+			ExtractResult result;
+			result.path = dirPath;
+			result.status = RPK_INVALID_PATH;
+			results.push_back(result);
+			return results;
+		}
+		// Paths below the directory start after its own path and the separator
+		const std::size_t prefix = base == 0 ? 0 : _entries[base].pathLength + 1;
+		std::error_code error;
+		std::filesystem::create_directories(targetDir, error);
+		std::vector<std::uint32_t> pending = { base };
+		while (!pending.empty()) {
+			const IndexEntry& dir = _entries[pending.back()];
+			pending.pop_back();
+			for (std::uint32_t i = 0; i < dir.childCount; i++) {
+				const std::uint32_t index = _children[dir.firstChild + i];
+				const IndexEntry& entry = _entries[index];
+				std::string path = getEntryPath(entry);
+				std::string targetPath;
+				if (!joinTarget(targetDir, path.substr(prefix), targetPath)) {
+					RPK_ERROR("'" + path + "' would be extracted outside of the target directory");
+					ExtractResult result;
+					result.path = path;
+					result.status = RPK_INVALID_PATH;
+					results.push_back(result);
+					indices.push_back(UINT32_MAX);
+					continue;
+				}
+				if (!entry.isFile()) {
+					// Directories are created here so empty ones survive, files only create their parents
+					std::filesystem::create_directories(targetPath, error);
+					pending.push_back(index);
+					continue;
+				}
+				ExtractResult result;
+				result.path = path;
+				result.targetPath = targetPath;
+				results.push_back(result);
+				indices.push_back(index);
+			}
+		}
+		extractEntries(indices, results, threads);
+		return results;
+	}
+	void ArchiveReader::extractEntries(const std::vector<std::uint32_t>& indices, std::vector<ExtractResult>& results, std::size_t threads) const
+	{
+		std::vector<std::size_t> order;
+		order.reserve(results.size());
+		std::unordered_set<std::string> targets, parents;
+		for (std::size_t i = 0; i < results.size(); i++) {
+			if (results[i].status != RPK_OK) continue;
+			// A file listed twice is only written once, the second copy would find the first one
+			if (!targets.insert(results[i].targetPath).second) {
+				RPK_ERROR("Target already exists");
+				results[i].status = RPK_OUTPUT_EXISTS;
+				continue;
+			}
+			order.push_back(i);
+			recordAccess(indices[i]);
+			parents.insert(std::filesystem::path(results[i].targetPath).parent_path().string());
+		}
+		// Creating all directories up front keeps the workers from racing on shared parents
+		for (auto& parent : parents) {
+			std::error_code error;
+			if (!parent.empty()) std::filesystem::create_directories(parent, error);
+		}
+		// Reading in archive order keeps the disk access sequential
+		std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+			return _entries[indices[a]].begin < _entries[indices[b]].begin;
+		});
+
+		std::atomic<std::size_t> next = 0;
+		ThreadPool::run(threads, order.size(), [&]() {
+			platform::Buffer buffer;
+			for (std::size_t i = next++; i < order.size(); i = next++) {
+				ExtractResult& result = results[order[i]];
+				result.status = writeEntry(_entries[indices[order[i]]], result.targetPath, buffer);
+			}
+		});
+	}
+	std::vector<ExtractResult> ArchiveReader::verify(std::size_t threads) const
+	{
+		// Copies of deduplicated files share their range, it is checked once for all of them
+		std::vector<std::uint32_t> files;
+		for (std::uint32_t i = 1; i < (std::uint32_t)_entries.size(); i++) {
+			if (_entries[i].isFile()) files.push_back(i);
+		}
+		std::sort(files.begin(), files.end(), [&](std::uint32_t a, std::uint32_t b) {
+			const IndexEntry& first = _entries[a];
+			const IndexEntry& second = _entries[b];
+			return first.begin != second.begin ? first.begin < second.begin : first.end != second.end ? first.end < second.end : a < b;
+		});
+		std::vector<std::size_t> groups;
+		for (std::size_t i = 0; i < files.size(); i++) {
+			if (i == 0 || _entries[files[i]].begin != _entries[files[i - 1]].begin || _entries[files[i]].end != _entries[files[i - 1]].end)
+				groups.push_back(i);
+		}
+		groups.push_back(files.size());
+
+		std::vector<ExtractResult> ret;
+		std::mutex mutex;
+		std::atomic<std::size_t> next = 0;
+		ThreadPool::run(threads, groups.size() - 1, [&]() {
+			platform::Buffer buffer;
+			std::string decoded;
+			for (std::size_t group = next++; group + 1 < groups.size(); group = next++) {
+				const IndexEntry& entry = _entries[files[groups[group]]];
+				int status = RPK_OK;
+				if (entry.codec != RPK_CODEC_NONE && entry.codec != RPK_CODEC_LZ4) {
+					status = RPK_UNSUPPORTED_CODEC;
+				}
+				else if ((entry.traits & RPK_TRAIT_CHECKSUM) || entry.codec == RPK_CODEC_NONE) {
+					std::uint32_t crc = 0;
+					for (std::uint64_t pos = entry.begin; pos < entry.end && status == RPK_OK;) {
+						std::size_t length = (std::size_t)std::min<std::uint64_t>(buffer.getLength(), entry.end - pos);
+						if (_file->readAt(pos, buffer.getData(), length) != length) status = RPK_CORRUPT_ARCHIVE;
+						crc = crc32c(crc, buffer.getData(), length);
+						pos += length;
+					}
+					if (status == RPK_OK && (entry.traits & RPK_TRAIT_CHECKSUM) && crc != entry.checksum) status = RPK_CHECKSUM_MISMATCH;
+				}
+				else {
+					// Without a checksum a compressed file at least has to decode
+					decoded.resize((std::size_t)entry.length);
+					status = readEntry(entry, &decoded[0]);
+				}
+				if (status == RPK_OK) continue;
+				std::lock_guard<std::mutex> lock(mutex);
+				for (std::size_t i = groups[group]; i < groups[group + 1]; i++) {
+					ExtractResult result;
+					result.path = getEntryPath(_entries[files[i]]);
+					result.status = status;
+					ret.push_back(result);
+				}
+			}
+		});
+		std::sort(ret.begin(), ret.end(), [](const ExtractResult& a, const ExtractResult& b) { return a.path < b.path; });
+		return ret;
+	}
+}
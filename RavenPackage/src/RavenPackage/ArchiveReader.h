@@ -0,0 +1,237 @@
+#pragma once
+
+#include "RavenPackage.h"
+#include "EntryCache.h"
+#include "EntryStream.h"
+#include "PathQuery.h"
+#include "Format.h"
+#include "Platform.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace rvn {
+	// Read-only view of a file inside an archive. The data stays valid as long as a copy of
+	// the view exists, even if the reader it came from is closed
+	struct EntryView {
+		int status = RPK_OK;
+		std::string_view data;
+		std::shared_ptr<const void> owner;
+	};
+	// Outcome of one file of a batch extraction
+	struct ExtractResult {
+		// Path inside the archive
+		std::string path;
+		std::string targetPath;
+		int status = RPK_OK;
+	};
+	// Opens a Raven Package once, validates it and keeps its whole directory tree in memory.
+	// Lookups and listings don't touch the disk, reads only cost the payload read itself.
+	// All const member functions can be called from several threads at once.
+	class ArchiveReader {
+	public:
+		ArchiveReader() = default;
+		ArchiveReader(const ArchiveReader&) = delete;
+		ArchiveReader& operator=(const ArchiveReader&) = delete;
+		ArchiveReader(ArchiveReader&&) = default;
+		ArchiveReader& operator=(ArchiveReader&&) = default;
+
+		// Opens an archive and parses its index, returns one of the RPK_* codes
+		int open(const std::string& archPath);
+		void close();
+		bool isOpen() const { return _file && _file->isOpen(); }
+		const std::string& getPath() const { return _archPath; }
+		std::uint8_t getVersion() const { return _version; }
+		// Number of files and directories in the archive
+		std::size_t getEntryCount() const { return _entries.empty() ? 0 : _entries.size() - 1; }
+		// Bytes no entry points at anymore, left behind by package::updateArchive.
+		// package::compactArchive gets rid of them
+		std::uint64_t getStaleBytes() const;
+		// Payload alignment the archive was created with (CreateOptions::alignment), 0 if payloads are packed
+		std::uint32_t getAlignment() const { return _alignment; }
+		// Whether whole-file reads and extraction check payload checksums, on by default.
+		// Views and streams are never checked, verify() covers those use cases
+		void setVerifyChecksums(bool verify) { _verifyChecksums = verify; }
+		// Keeps up to byteBudget bytes of decoded files in memory for getShared and extractToString,
+		// 0 turns the cache off. Not safe to call while other threads read from this reader
+		void setCacheBudget(std::size_t byteBudget);
+		CacheStats getCacheStats() const;
+		// Records the path of every file read through this reader or an AsyncReader on it, in the order the
+		// reads are requested. Turning it on drops the previous trace, turning it off keeps it.
+		// Not safe to call while other threads read from this reader
+		void setAccessTracing(bool enabled);
+		// Recorded paths in first-touch order, each path once
+		std::vector<std::string> getAccessTrace() const;
+		// Writes the trace as text, one path per line, see package::readAccessTrace
+		int writeAccessTrace(const std::string& tracePath) const;
+
+		// Paths this archive deletes from the archives below it in a VirtualFileSystem, sorted
+		const std::vector<std::string>& getDeletions() const { return _deletions; }
+
+		// Whether a file or directory exists at the path
+		bool exists(const std::string& filePath) const;
+		// Extracts a file from the archive to a certain location
+		int extractFile(const std::string& filePath, const std::string& targetPath) const;
+		// Extracts a file and gives it the name it had in the archive
+		int extractFile(const std::string& filePath) const;
+		// Extracts a file to a string
+		std::pair<int, std::shared_ptr<std::string>> extractToString(const std::string& filePath) const;
+		// Decoded contents of a file, served from the cache if it is enabled. The buffer is shared,
+		// repeated calls for a cached file don't read or copy anything
+		std::pair<int, std::shared_ptr<const std::string>> getShared(const std::string& filePath) const;
+		// Lists all directories and files in a directory of the archive. Directory totals are part of the
+		// index, so listings never look at anything below the listed children
+		Entries getEntriesAt(const std::string& filePath) const;
+		// The file or directory at a path, "" is the root
+		std::pair<int, Entry> getEntry(const std::string& filePath) const;
+		// Files and directories whose path starts with prefix, "materials/" for everything below a directory.
+		// Iterated lazily in path order, see PathQuery
+		PathQuery queryPrefix(const std::string& prefix) const;
+		// Files and directories whose path matches a glob like "materials/**/*.shader", see matchGlob.
+		// Only the paths starting with the part before the first wildcard are looked at
+		PathQuery query(const std::string& pattern) const;
+		// Zero-copy access to a file. The archive is memory mapped on the first call,
+		// only the pages that are actually touched get loaded. Compressed files are decompressed
+		// into a buffer owned by the view, files of solid blocks point into their decoded block
+		EntryView view(const std::string& filePath) const;
+		// Reads a file into a new buffer aligned to RPK_COPY_BUFFER_ALIGNMENT, bypassing the OS cache.
+		// Meant for large assets of aligned archives, whose payloads start on a block boundary so no
+		// neighbouring data is read. Compressed files and file systems without unbuffered I/O use normal reads
+		EntryView readUnbuffered(const std::string& filePath) const;
+		// Opens a file for reading it in pieces, memory use doesn't depend on the file size
+		EntryStream openStream(const std::string& filePath) const;
+
+		// Extracts several files below targetDir, each keeps its path from the archive.
+		// Files are read in the order they are stored in, 0 threads uses one per core.
+		// Results are in the same order as filePaths
+		std::vector<ExtractResult> extractMany(const std::vector<std::string>& filePaths, const std::string& targetDir, std::size_t threads = 1) const;
+		// Extracts everything below a directory of the archive into targetDir, including empty directories
+		std::vector<ExtractResult> extractDirectory(const std::string& dirPath, const std::string& targetDir, std::size_t threads = 1) const;
+		// Reads every payload and checks its checksum, files stored without one only have to be readable
+		// and decompress. Returns the files that failed sorted by path, 0 threads uses one per core
+		std::vector<ExtractResult> verify(std::size_t threads = 0) const;
+	private:
+		friend struct package;
+		friend class AsyncReader;
+		friend class VirtualFileSystem;
+		friend class PathQuery;
+		struct IndexEntry {
+			// Stored bytes in the archive
+			std::uint64_t begin = 0;
+			std::uint64_t end = 0;
+			// Length after decompressing, for directories the total of all files below
+			std::uint64_t length = 0;
+			// Files anywhere below a directory
+			std::uint64_t fileCount = 0;
+			std::uint32_t parent = 0;
+			// Full normalized path inside _paths, the name is its last component
+			std::uint32_t pathOffset = 0;
+			std::uint32_t pathLength = 0;
+			std::uint32_t nameOffset = 0;
+			// Children inside _children
+			std::uint32_t firstChild = 0;
+			std::uint32_t childCount = 0;
+			std::uint8_t traits = 0;
+			std::uint8_t codec = RPK_CODEC_NONE;
+			// CRC32C of the stored bytes, RPK_TRAIT_CHECKSUM
+			std::uint32_t checksum = 0;
+			// Files in a solid block carry the range, codec and checksum of the block,
+			// the file itself starts at offset in the decoded block
+			std::uint32_t block = RPK_V2_NO_BLOCK;
+			std::uint64_t offset = 0;
+			bool isFile() const { return traits & RPK_TRAIT_IS_FILE; }
+			bool isSolid() const { return block != RPK_V2_NO_BLOCK; }
+		};
+		// Open addressing slot, hash of the full path and index of the entry.
+		// Version 2 archives store this table, for version 1 it is built when opening
+		struct Slot {
+			std::uint64_t hash = 0;
+			std::uint32_t index = UINT32_MAX;
+		};
+
+		int loadV1();
+		int loadV2();
+		void buildSlots();
+		// Adds up fileCount and length of every directory, stored totals are kept unless recompute is set
+		void buildTotals(bool recompute);
+		std::uint32_t addEntry(std::uint32_t parent, const char* name, std::size_t nameLength, std::uint8_t traits);
+		// Index of the entry at the path or UINT32_MAX
+		std::uint32_t find(const std::string& filePath) const;
+		// Adds a file to the access trace, if one is being recorded
+		void recordAccess(std::uint32_t index) const;
+		std::string getEntryPath(const IndexEntry& entry) const { return _paths.substr(entry.pathOffset, entry.pathLength); }
+		std::string getEntryName(const IndexEntry& entry) const { return _paths.substr(entry.nameOffset, entry.pathLength - (entry.nameOffset - entry.pathOffset)); }
+		Entry makeEntry(const IndexEntry& entry) const;
+		// Reads and decompresses a whole file, dst has to hold entry.length bytes
+		int readEntry(const IndexEntry& entry, char* dst) const;
+		// readEntry for the stored payload of an entry, solid files get their whole block
+		int readPayload(const IndexEntry& entry, char* dst) const;
+		// Decoded solid block of a file, through the block cache
+		int getBlock(const IndexEntry& entry, std::shared_ptr<const std::string>& data) const;
+		// Whole decoded file through the cache, if there is one
+		int readShared(std::uint32_t index, std::shared_ptr<const std::string>& data) const;
+		// RPK_OK if the entry has no checksum, checking is off or crc matches
+		int checkPayload(const IndexEntry& entry, std::uint32_t crc) const;
+		bool needsChecksum(const IndexEntry& entry) const { return _verifyChecksums && (entry.traits & RPK_TRAIT_CHECKSUM); }
+		// Writes a file to targetPath, which must not exist yet. The data goes to a new uniquely named file next to it
+		// that is only renamed once the whole payload is read and verified, a failed extraction leaves nothing behind.
+		// The rename never replaces a file, existing files are left alone even if they appear during the extraction
+		int writeEntry(const IndexEntry& entry, const std::string& targetPath, platform::Buffer& buffer) const;
+		// Decodes and verifies the payload of a file into out
+		int writePayload(const IndexEntry& entry, const platform::File& out, platform::Buffer& buffer) const;
+		// Extracts results[i] from entry indices[i], results that already failed are skipped
+		void extractEntries(const std::vector<std::uint32_t>& indices, std::vector<ExtractResult>& results, std::size_t threads) const;
+		std::shared_ptr<const platform::MappedFile> getMapping() const;
+		// Entry indices sorted by path, without the root. Archives written sorted only need a check
+		std::shared_ptr<const std::vector<std::uint32_t>> getPathOrder() const;
+		PathQuery makeQuery(std::string prefix, std::string pattern, bool glob) const;
+		// Unbuffered handle, not open if the file system doesn't support it
+		std::shared_ptr<const platform::File> getUnbufferedFile() const;
+		// The index as central directory records, parents come before their children
+		void getRecords(std::vector<format::Record>& records, std::vector<format::Block>& blocks) const;
+
+		std::string _archPath;
+		// Shared with the streams opened from this reader
+		std::shared_ptr<platform::File> _file = std::make_shared<platform::File>();
+		std::uint8_t _version = 0;
+		// Entry 0 is the root directory
+		std::vector<IndexEntry> _entries;
+		std::vector<std::uint32_t> _children;
+		std::string _paths;
+		std::vector<Slot> _slots;
+		// Length of the version 2 central directory
+		std::uint64_t _directoryLength = 0;
+		// RPK_V2_FLAG_ALIGNED
+		std::uint32_t _alignment = 0;
+		std::uint64_t _alignmentThreshold = 0;
+		// RPK_V2_FLAG_SOLID
+		std::vector<format::Block> _blocks;
+		// RPK_V2_FLAG_DELETIONS
+		std::vector<std::string> _deletions;
+		bool _verifyChecksums = true;
+		// Created lazily by view()
+		mutable std::shared_ptr<const platform::MappedFile> _mapping;
+		// Created lazily by readUnbuffered()
+		mutable std::shared_ptr<const platform::File> _unbufferedFile;
+		// Created lazily by the first query
+		mutable std::shared_ptr<const std::vector<std::uint32_t>> _pathOrder;
+		// Decoded files by entry index, nullptr if caching is off
+		std::unique_ptr<EntryCache> _cache;
+		// Last decoded solid blocks by block index, only there if the archive has blocks
+		std::unique_ptr<EntryCache> _blockCache;
+		struct AccessTrace {
+			std::mutex mutex;
+			bool recording = true;
+			std::vector<std::string> paths;
+			std::unordered_set<std::string> seen;
+		};
+		// nullptr until tracing is turned on, kept across close() and open()
+		std::unique_ptr<AccessTrace> _trace;
+	};
+}
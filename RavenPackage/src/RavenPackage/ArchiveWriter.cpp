@@ -0,0 +1,328 @@
+#include "ArchiveWriter.h"
+#include "Hash.h"
+#include "Platform.h"
+
+#include <algorithm>
+
+namespace rvn {
+	// The bytes of one file. Memory is handed out in place, everything else goes through a buffer
+	class ArchiveWriter::Input {
+	public:
+		Input(const char* data, std::size_t length)
+			: _data(data), _length(length), _memory(true), _known(true)
+		{}
+		Input(ReadCallback read, bool known, std::uint64_t length = 0)
+			: _read(std::move(read)), _length(length), _known(known)
+		{}
+		// Makes getAvailable see at least wanted bytes if the file has them, false on a read error
+		bool peek(std::uint64_t wanted)
+		{
+			return _known || fill(wanted);
+		}
+		// Bytes left before the first piece is taken, as far as they are known
+		std::uint64_t getAvailable() const
+		{
+			return _known ? _length - _offset : _buffer.length() - _consumed;
+		}
+		// Next piece of max bytes, shorter only at the end of the file and empty after it.
+		// The piece stays valid until the next call
+		bool next(std::size_t max, const char*& data, std::size_t& length)
+		{
+			if (_memory) {
+				length = (std::size_t)std::min<std::uint64_t>(max, _length - _offset);
+				data = _data + _offset;
+				_offset += length;
+				return true;
+			}
+			if (!fill(max)) return false;
+			length = std::min(max, _buffer.length());
+			data = _buffer.data();
+			_consumed = length;
+			return true;
+		}
+	private:
+		// Reads ahead until wanted bytes are buffered or the file ends
+		bool fill(std::uint64_t wanted)
+		{
+			if (_consumed) {
+				_buffer.erase(0, _consumed);
+				_consumed = 0;
+			}
+			while (_buffer.length() < wanted && !_ended) {
+				const std::size_t old = _buffer.length();
+				_buffer.resize((std::size_t)wanted);
+				const std::size_t read = _read(&_buffer[old], _buffer.length() - old);
+				if (read == RPK_READ_FAILED || read > _buffer.length() - old) return false;
+				_buffer.resize(old + read);
+				_ended = read == 0;
+			}
+			return true;
+		}
+
+		const char* _data = nullptr;
+		ReadCallback _read;
+		std::uint64_t _length = 0;
+		std::uint64_t _offset = 0;
+		bool _memory = false;
+		// Whether _length is known up front. It only decides about the alignment,
+		// callbacks are still read until they end the file
+		bool _known = false;
+		bool _ended = false;
+		std::string _buffer;
+		// Bytes at the start of _buffer that were handed out already
+		std::size_t _consumed = 0;
+	};
+
+	ArchiveWriter::ArchiveWriter(WriteCallback sink, const CreateOptions& options)
+		: _sink(std::move(sink)), _options(options)
+	{
+		if (_options.version != RPK_VERSION_2) {
+			RPK_ERROR("Streamed archives are always version 2");
+			_status = RPK_UNSUPPORTED_VERSION;
+		}
+		else if (_options.alignment & (_options.alignment - 1)) {
+			RPK_ERROR("Alignment has to be a power of two");
+			_status = RPK_INVALID_OPTIONS;
+		}
+	}
+	ArchiveWriter::ArchiveWriter(std::vector<char>& target, const CreateOptions& options)
+		: ArchiveWriter([&target](const char* data, std::size_t length) {
+			target.insert(target.end(), data, data + length);
+			return true;
+		}, options)
+	{}
+	ArchiveWriter::ArchiveWriter(std::ostream& target, const CreateOptions& options)
+		: ArchiveWriter([&target](const char* data, std::size_t length) {
+			return (bool)target.write(data, (std::streamsize)length);
+		}, options)
+	{}
+	int ArchiveWriter::addFile(const std::string& path, const char* data, std::size_t length)
+	{
+		Input input(data, length);
+		return writeFile(path, input);
+	}
+	int ArchiveWriter::addFile(const std::string& path, const std::string& harddrivePath)
+	{
+		if (_status != RPK_OK) return _status;
+		platform::File file;
+		if (!file.openRead(harddrivePath)) {
+			RPK_ERROR("Couldn't open file '" + harddrivePath + "'");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		const std::uint64_t size = file.getSize();
+		std::uint64_t offset = 0;
+		Input input([&](char* dst, std::size_t capacity) -> std::size_t {
+			const std::size_t read = file.readAt(offset, dst, capacity);
+			offset += read;
+			// Short before the end is a read error or a file that shrank, either way the data is incomplete
+			if (read < capacity && offset < size) {
+				RPK_ERROR("Couldn't read file '" + harddrivePath + "'");
+				return RPK_READ_FAILED;
+			}
+			return read;
+		}, true, size);
+		return writeFile(path, input);
+	}
+	int ArchiveWriter::addFile(const std::string& path, std::istream& source)
+	{
+		Input input([&](char* dst, std::size_t capacity) -> std::size_t {
+			source.read(dst, (std::streamsize)capacity);
+			if (source.bad()) return RPK_READ_FAILED;
+			return (std::size_t)source.gcount();
+		}, false);
+		return writeFile(path, input);
+	}
+	int ArchiveWriter::addFile(const std::string& path, const ReadCallback& source)
+	{
+		Input input(source, false);
+		return writeFile(path, input);
+	}
+	int ArchiveWriter::addDirectory(const std::string& path)
+	{
+		std::string normalized;
+		return addEntry(path, false, normalized);
+	}
+	int ArchiveWriter::addDeletion(const std::string& path)
+	{
+		if (_status != RPK_OK) return _status;
+		if (_finished) {
+			RPK_ERROR("Archive is already finished");
+			return RPK_INVALID_OPTIONS;
+		}
+		std::string normalized = format::normalizePath(path);
+		if (normalized.empty() || normalized.length() > RPK_V2_MAX_PATH_LENGTH || !format::isSafePath(normalized)) {
+			RPK_ERROR("Invalid path '" + path + "'");
+			return RPK_INVALID_PATH;
+		}
+		_deletions.push_back(std::move(normalized));
+		return RPK_OK;
+	}
+	int ArchiveWriter::finish()
+	{
+		if (_status != RPK_OK) return _status;
+		if (_finished) return RPK_OK;
+		if (_records.empty() && _deletions.empty()) {
+			RPK_ERROR("Base directory is empty");
+			return RPK_DIR_IS_EMPTY;
+		}
+		if (!writeHeader()) return _status;
+		std::sort(_deletions.begin(), _deletions.end());
+		_deletions.erase(std::unique(_deletions.begin(), _deletions.end()), _deletions.end());
+		const std::uint64_t directoryOffset = _position;
+		std::string directory = format::buildDirectory(_records, _options.alignment, _options.alignmentThreshold, {}, _deletions);
+		directory += format::buildFooter(directoryOffset, directory);
+		if (!write(directory.data(), directory.length())) return _status;
+		_finished = true;
+		return RPK_OK;
+	}
+	int ArchiveWriter::addEntry(const std::string& path, bool isFile, std::string& normalized)
+	{
+		if (_status != RPK_OK) return _status;
+		if (_finished) {
+			RPK_ERROR("Archive is already finished");
+			return RPK_INVALID_OPTIONS;
+		}
+		normalized = format::normalizePath(path);
+		if (normalized.empty() || normalized.length() > RPK_V2_MAX_PATH_LENGTH || !format::isSafePath(normalized)) {
+			RPK_ERROR("Invalid path '" + path + "'");
+			return RPK_INVALID_PATH;
+		}
+		auto existing = _indices.find(normalized);
+		if (existing != _indices.end()) {
+			// Adding a directory twice is fine
+			if (!isFile && !(_records[existing->second].traits & RPK_TRAIT_IS_FILE)) return RPK_OK;
+			RPK_ERROR("'" + normalized + "' is already in the archive");
+			return RPK_INVALID_PATH;
+		}
+		if (_records.size() + (std::size_t)std::count(normalized.begin(), normalized.end(), '/') >= RPK_V2_NO_PARENT - 1) {
+			RPK_ERROR("Archive contains too many files and directories");
+			return RPK_TOO_MANY_FILES;
+		}
+		std::uint32_t parent = RPK_V2_NO_PARENT;
+		for (std::size_t separator = normalized.find('/'); separator != std::string::npos; separator = normalized.find('/', separator + 1)) {
+			std::string dirPath = normalized.substr(0, separator);
+			auto it = _indices.find(dirPath);
+			if (it != _indices.end()) {
+				if (_records[it->second].traits & RPK_TRAIT_IS_FILE) {
+					RPK_ERROR("Parent of '" + normalized + "' is a file in the archive");
+					return RPK_INVALID_PATH;
+				}
+				parent = it->second;
+				continue;
+			}
+			format::Record record;
+			record.path = dirPath;
+			record.parent = parent;
+			parent = (std::uint32_t)_records.size();
+			_indices.emplace(std::move(dirPath), parent);
+			_records.push_back(std::move(record));
+		}
+		format::Record record;
+		record.path = normalized;
+		record.parent = parent;
+		record.traits = isFile ? RPK_TRAIT_IS_FILE : 0;
+		_indices.emplace(normalized, (std::uint32_t)_records.size());
+		_records.push_back(std::move(record));
+		return RPK_OK;
+	}
+	int ArchiveWriter::writeFile(const std::string& path, Input& input)
+	{
+		std::string normalized;
+		int status = addEntry(path, true, normalized);
+		if (status != RPK_OK) return status;
+		if (!writeHeader()) return _status;
+
+		Compression compression = _options.compression;
+		auto it = _options.extensionCompression.find(package::util::getExtension(normalized));
+		if (it != _options.extensionCompression.end()) compression = it->second;
+		if (compression.codec != RPK_CODEC_NONE && compression.codec != RPK_CODEC_LZ4) {
+			RPK_ERROR("Unsupported codec for file '" + normalized + "'");
+			return fail(RPK_UNSUPPORTED_CODEC);
+		}
+		// Large files start at a multiple of the alignment, unknown lengths are read ahead to the threshold
+		if (_options.alignment > 1) {
+			if (!input.peek(_options.alignmentThreshold)) {
+				RPK_ERROR("Couldn't read file '" + normalized + "'");
+				return fail(RPK_COULDNT_OPEN_FILE);
+			}
+			if (input.getAvailable() >= _options.alignmentThreshold) {
+				static const char zeros[RPK_BUFFER_SIZE] = {};
+				const std::uint64_t aligned = (_position + _options.alignment - 1) & ~(std::uint64_t)(_options.alignment - 1);
+				while (_position < aligned) {
+					if (!write(zeros, (std::size_t)std::min<std::uint64_t>(sizeof(zeros), aligned - _position))) return _status;
+				}
+			}
+		}
+
+		const char* data;
+		std::size_t length;
+		if (!input.next(RPK_COMPRESSION_CHUNK_SIZE, data, length)) {
+			RPK_ERROR("Couldn't read file '" + normalized + "'");
+			return fail(RPK_COULDNT_OPEN_FILE);
+		}
+		// The first chunk decides whether compressing is worth it, like for package::createArchive
+		_encoded.clear();
+		const bool compressed = compression.codec == RPK_CODEC_LZ4 && length > 0
+			&& compression::encodeChunk(data, length, _encoded, compression.level) && _encoded.length() < length;
+		const std::uint64_t begin = _position;
+		std::uint64_t decoded = 0;
+		std::uint32_t checksum = 0;
+		for (bool first = true; length > 0; first = false) {
+			const char* out = data;
+			std::size_t outLength = length;
+			if (compressed) {
+				if (!first) {
+					_encoded.clear();
+					compression::encodeChunk(data, length, _encoded, compression.level);
+				}
+				out = _encoded.data();
+				outLength = _encoded.length();
+			}
+			if (_options.checksums) checksum = crc32c(checksum, out, outLength);
+			if (!write(out, outLength)) return _status;
+			decoded += length;
+			if (!input.next(RPK_COMPRESSION_CHUNK_SIZE, data, length)) {
+				RPK_ERROR("Couldn't read file '" + normalized + "'");
+				return fail(RPK_COULDNT_OPEN_FILE);
+			}
+		}
+
+		format::Record& record = _records.back();
+		record.begin = begin;
+		record.end = _position;
+		if (compressed) {
+			record.traits |= RPK_TRAIT_COMPRESSED;
+			record.codec = compression.codec;
+			record.length = decoded;
+		}
+		if (_options.checksums) {
+			record.traits |= RPK_TRAIT_CHECKSUM;
+			record.checksum = checksum;
+		}
+		return RPK_OK;
+	}
+	bool ArchiveWriter::writeHeader()
+	{
+		if (_position != 0) return true;
+		std::string header = RPK_MAGIC_NUMBER;
+		header.push_back((char)RPK_VERSION_2);
+		return write(header.data(), header.length());
+	}
+	bool ArchiveWriter::write(const char* data, std::size_t length)
+	{
+		if (length == 0) return true;
+		if (!_sink(data, length)) {
+			RPK_ERROR("Couldn't write output");
+			fail(RPK_COULDNT_OPEN_FILE);
+			return false;
+		}
+		_position += length;
+		metrics::add(metrics::Counter::BytesWritten, length);
+		return true;
+	}
+	int ArchiveWriter::fail(int status)
+	{
+		if (_status == RPK_OK) _status = status;
+		return _status;
+	}
+}
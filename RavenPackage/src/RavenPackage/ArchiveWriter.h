@@ -0,0 +1,75 @@
+#pragma once
+
+#include "RavenPackage.h"
+#include "Format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rvn {
+	// Receives the bytes of an archive in order, false stops the writer
+	using WriteCallback = std::function<bool(const char* data, std::size_t length)>;
+
+	// Writes a version 2 archive front to back in a single pass, so the output never has to be seekable:
+	// a pipe, a socket, memory or a callback. Every payload is written while its file is added, the central
+	// directory and the footer follow in finish(). Files don't need a known length, they can come from
+	// streams and producers that only know their end when they reach it. Nothing is stat'ed up front.
+	// Solid blocks, deduplication and accessOrder need all files before writing and are ignored, threads too.
+	// Sources of unknown length are held in memory up to the alignmentThreshold when alignment is on.
+	// A failed call leaves the output unusable, every later call returns the same error
+	class ArchiveWriter {
+	public:
+		explicit ArchiveWriter(WriteCallback sink, const CreateOptions& options = CreateOptions());
+		// Appends the archive to target
+		explicit ArchiveWriter(std::vector<char>& target, const CreateOptions& options = CreateOptions());
+		// Writes to a stream that is never asked to seek, e.g. std::cout piped into another program
+		explicit ArchiveWriter(std::ostream& target, const CreateOptions& options = CreateOptions());
+		ArchiveWriter(const ArchiveWriter&) = delete;
+		ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+		// RPK_OK or the error that stopped the writer
+		int getStatus() const { return _status; }
+		// Bytes handed to the sink so far
+		std::uint64_t getBytesWritten() const { return _position; }
+
+		// Parent directories are added with the file. Every call returns one of the RPK_* codes
+		int addFile(const std::string& path, const char* data, std::size_t length);
+		// Reads the file from the harddrive, RPK_COULDNT_OPEN_FILE if less than its size can be read
+		int addFile(const std::string& path, const std::string& harddrivePath);
+		// Reads the stream until its end
+		int addFile(const std::string& path, std::istream& source);
+		// Calls the producer until it returns 0
+		int addFile(const std::string& path, const ReadCallback& source);
+		int addDirectory(const std::string& path);
+		// See PackageCreator::addDeletion
+		int addDeletion(const std::string& path);
+		// Writes the central directory and the footer, nothing can be added after this
+		int finish();
+	private:
+		class Input;
+		// Normalized path, checked against the entries added so far. Adds the missing parents
+		int addEntry(const std::string& path, bool isFile, std::string& normalized);
+		int writeFile(const std::string& path, Input& input);
+		// Magic number and version, before the first payload
+		bool writeHeader();
+		bool write(const char* data, std::size_t length);
+		int fail(int status);
+
+		WriteCallback _sink;
+		CreateOptions _options;
+		int _status = RPK_OK;
+		bool _finished = false;
+		std::uint64_t _position = 0;
+		std::vector<format::Record> _records;
+		// Index of every path in _records
+		std::unordered_map<std::string, std::uint32_t> _indices;
+		std::vector<std::string> _deletions;
+		std::string _encoded;
+	};
+}
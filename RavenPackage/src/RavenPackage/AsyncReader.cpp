@@ -0,0 +1,339 @@
+#include "AsyncReader.h"
+#include "Hash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+	#include <linux/io_uring.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <unistd.h>
+	#include <cerrno>
+#endif
+
+namespace rvn {
+	struct AsyncReader::Request {
+		std::uint64_t id = 0;
+		std::uint32_t index = UINT32_MAX;
+		int status = RPK_OK;
+		std::atomic<bool> cancelled = false;
+		AsyncCallback callback;
+		// Stored bytes, decoded into data for compressed files
+		std::string stored;
+		std::shared_ptr<std::string> data;
+		std::uint64_t done = 0;
+#ifdef __linux__
+		iovec vector = {};
+#endif
+	};
+
+#ifdef __linux__
+	// Minimal io_uring setup over the raw system calls, only what batched reads need
+	struct AsyncReader::Ring {
+		~Ring()
+		{
+			if (sqes) munmap(sqes, sqesSize);
+			if (cqPointer && cqPointer != sqPointer) munmap(cqPointer, cqSize);
+			if (sqPointer) munmap(sqPointer, sqSize);
+			if (fd >= 0) close(fd);
+		}
+		bool init(unsigned entries)
+		{
+			io_uring_params params = {};
+			fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+			if (fd < 0) return false;
+			sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+			if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+			void* sq = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sq == MAP_FAILED) return false;
+			sqPointer = sq;
+			void* cq = single ? sq : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cq == MAP_FAILED) return false;
+			cqPointer = cq;
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			void* entriesPointer = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+			if (entriesPointer == MAP_FAILED) return false;
+			sqes = (io_uring_sqe*)entriesPointer;
+			sqHead = (unsigned*)((char*)sq + params.sq_off.head);
+			sqTail = (unsigned*)((char*)sq + params.sq_off.tail);
+			sqMask = (unsigned*)((char*)sq + params.sq_off.ring_mask);
+			sqArray = (unsigned*)((char*)sq + params.sq_off.array);
+			cqHead = (unsigned*)((char*)cq + params.cq_off.head);
+			cqTail = (unsigned*)((char*)cq + params.cq_off.tail);
+			cqMask = (unsigned*)((char*)cq + params.cq_off.ring_mask);
+			cqes = (io_uring_cqe*)((char*)cq + params.cq_off.cqes);
+			capacity = params.sq_entries;
+			return true;
+		}
+		// Queues a readv, the kernel only sees it after enter()
+		void pushRead(int file, const iovec* vector, std::uint64_t offset, std::uint64_t userData)
+		{
+			const unsigned tail = *sqTail;
+			const unsigned index = tail & *sqMask;
+			io_uring_sqe& sqe = sqes[index];
+			std::memset(&sqe, 0, sizeof(sqe));
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = file;
+			sqe.addr = (std::uint64_t)(std::uintptr_t)vector;
+			sqe.len = 1;
+			sqe.off = offset;
+			sqe.user_data = userData;
+			sqArray[index] = index;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			pending++;
+		}
+		// Submits everything queued and waits for at least minComplete completions
+		bool enter(unsigned minComplete)
+		{
+			for (;;) {
+				int result = (int)syscall(__NR_io_uring_enter, fd, pending, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+				if (result >= 0) {
+					pending -= std::min<unsigned>(pending, (unsigned)result);
+					return true;
+				}
+				if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+			}
+		}
+		template<typename Handler>
+		void reap(Handler handler)
+		{
+			unsigned head = *cqHead;
+			const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++) {
+				const io_uring_cqe& cqe = cqes[head & *cqMask];
+				handler(cqe.user_data, cqe.res);
+			}
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		}
+
+		int fd = -1;
+		unsigned capacity = 0;
+		unsigned pending = 0;
+		void* sqPointer = nullptr;
+		void* cqPointer = nullptr;
+		std::size_t sqSize = 0;
+		std::size_t cqSize = 0;
+		std::size_t sqesSize = 0;
+		io_uring_sqe* sqes = nullptr;
+		io_uring_cqe* cqes = nullptr;
+		unsigned* sqHead = nullptr;
+		unsigned* sqTail = nullptr;
+		unsigned* sqMask = nullptr;
+		unsigned* sqArray = nullptr;
+		unsigned* cqHead = nullptr;
+		unsigned* cqTail = nullptr;
+		unsigned* cqMask = nullptr;
+	};
+#else
+	struct AsyncReader::Ring {};
+#endif
+
+	AsyncReader::AsyncReader(const ArchiveReader& reader, const AsyncOptions& options)
+		: _reader(reader), _options(options)
+	{
+		_options.queueDepth = std::max<std::size_t>(_options.queueDepth, 1);
+#ifdef __linux__
+		if (_options.useIoUring) {
+			auto ring = std::make_unique<Ring>();
+			if (ring->init((unsigned)std::min<std::size_t>(_options.queueDepth, 4096))) {
+				_ring = std::move(ring);
+				_ringThread = std::thread([this]() { runRing(); });
+				return;
+			}
+		}
+#endif
+		// Blocking preads overlap a little beyond one thread per core, more threads only cost memory and switches
+		_pool = std::make_unique<ThreadPool>(std::min(_options.queueDepth, ThreadPool::resolveThreadCount(0) * 2));
+	}
+	AsyncReader::~AsyncReader()
+	{
+		cancelAll();
+		wait();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		if (_ringThread.joinable()) _ringThread.join();
+		_pool.reset();
+	}
+	std::uint64_t AsyncReader::submit(const std::string& filePath, AsyncCallback callback)
+	{
+		return enqueue(filePath, std::move(callback));
+	}
+	std::pair<std::uint64_t, std::future<AsyncResult>> AsyncReader::submit(const std::string& filePath)
+	{
+		auto promise = std::make_shared<std::promise<AsyncResult>>();
+		std::future<AsyncResult> future = promise->get_future();
+		std::uint64_t id = enqueue(filePath, [promise](AsyncResult result) { promise->set_value(std::move(result)); });
+		return { id, std::move(future) };
+	}
+	std::uint64_t AsyncReader::enqueue(const std::string& filePath, AsyncCallback callback)
+	{
+		auto request = std::make_shared<Request>();
+		request->callback = std::move(callback);
+		request->index = _reader.find(filePath);
+		if (request->index == UINT32_MAX || !_reader._entries[request->index].isFile()) {
+			RPK_ERROR("File doesn't exist in archive");
+			request->status = RPK_INVALID_PATH;
+		}
+		else {
+			_reader.recordAccess(request->index);
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			request->id = _nextId++;
+			_requests.emplace(request->id, request);
+			if (_ring) _queue.push_back(request);
+		}
+		if (_ring) {
+			_wake.notify_one();
+		}
+		else {
+			_pool->submit([this, request]() {
+				if (request->status == RPK_OK && !request->cancelled) {
+					const ArchiveReader::IndexEntry& entry = _reader._entries[request->index];
+					request->data = std::make_shared<std::string>((std::size_t)entry.length, 0x00);
+					request->status = _reader.readEntry(entry, &(*request->data)[0]);
+				}
+				finish(request);
+			});
+		}
+		return request->id;
+	}
+	bool AsyncReader::cancel(std::uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _requests.find(id);
+		if (it == _requests.end()) return false;
+		it->second->cancelled = true;
+		return true;
+	}
+	void AsyncReader::cancelAll()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& request : _requests) request.second->cancelled = true;
+	}
+	void AsyncReader::wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_idle.wait(lock, [this]() { return _requests.empty(); });
+	}
+	void AsyncReader::finish(const std::shared_ptr<Request>& request)
+	{
+		AsyncResult result;
+		result.id = request->id;
+		if (request->cancelled) {
+			result.status = RPK_CANCELLED;
+		}
+		else {
+			result.status = request->status;
+			if (result.status == RPK_OK) result.data = std::move(request->data);
+		}
+		if (request->callback) request->callback(std::move(result));
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.erase(request->id);
+		if (_requests.empty()) _idle.notify_all();
+	}
+	void AsyncReader::runRing()
+	{
+#ifdef __linux__
+		const int file = _reader._file->getDescriptor();
+		std::unordered_map<std::uint64_t, std::shared_ptr<Request>> inFlight;
+		std::vector<std::shared_ptr<Request>> started;
+		for (;;) {
+			started.clear();
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [&]() { return _stopping || !inFlight.empty() || !_queue.empty(); });
+				if (_stopping && inFlight.empty() && _queue.empty()) return;
+				while (!_queue.empty() && inFlight.size() + started.size() < _ring->capacity) {
+					started.push_back(std::move(_queue.front()));
+					_queue.pop_front();
+				}
+			}
+			for (auto& request : started) {
+				if (request->status != RPK_OK || request->cancelled) {
+					finish(request);
+					continue;
+				}
+				const ArchiveReader::IndexEntry& entry = _reader._entries[request->index];
+				const std::size_t stored = (std::size_t)(entry.end - entry.begin);
+				if (entry.codec != RPK_CODEC_NONE && entry.codec != RPK_CODEC_LZ4) {
+					RPK_ERROR("Unsupported codec");
+					request->status = RPK_UNSUPPORTED_CODEC;
+					finish(request);
+					continue;
+				}
+				request->data = std::make_shared<std::string>((std::size_t)entry.length, 0x00);
+				if (entry.isSolid()) {
+					// Neighbouring small files share their block, it usually is in the block cache already
+					request->status = _reader.readEntry(entry, &(*request->data)[0]);
+					finish(request);
+					continue;
+				}
+				if (stored == 0) {
+					finish(request);
+					continue;
+				}
+				// Uncompressed files are read straight into the result
+				char* target = &(*request->data)[0];
+				if (entry.codec != RPK_CODEC_NONE) {
+					request->stored.assign(stored, 0x00);
+					target = &request->stored[0];
+				}
+				request->vector.iov_base = target;
+				request->vector.iov_len = stored;
+				_ring->pushRead(file, &request->vector, entry.begin, request->id);
+				inFlight.emplace(request->id, request);
+			}
+			if (!_ring->enter(inFlight.empty() ? 0 : 1)) {
+				// The ring broke, every read in flight fails
+				for (auto& request : inFlight) {
+					request.second->status = RPK_COULDNT_OPEN_FILE;
+					finish(request.second);
+				}
+				inFlight.clear();
+				_ring->pending = 0;
+				continue;
+			}
+			_ring->reap([&](std::uint64_t id, int result) {
+				auto it = inFlight.find(id);
+				if (it == inFlight.end()) return;
+				std::shared_ptr<Request> request = it->second;
+				const ArchiveReader::IndexEntry& entry = _reader._entries[request->index];
+				const std::uint64_t stored = entry.end - entry.begin;
+				if (result > 0) request->done += (std::uint64_t)result;
+				if (result > 0 && request->done < stored && !request->cancelled) {
+					// Short read, the rest is queued again
+					request->vector.iov_base = (char*)request->vector.iov_base + result;
+					request->vector.iov_len -= (std::size_t)result;
+					_ring->pushRead(file, &request->vector, entry.begin + request->done, request->id);
+					return;
+				}
+				inFlight.erase(it);
+				if (result < 0 || request->done != stored) {
+					RPK_ERROR("Couldn't read file from archive");
+					request->status = RPK_CORRUPT_ARCHIVE;
+				}
+				else if (!request->cancelled) {
+					// Checked before decoding, so the decoder never sees damaged input
+					const std::string& payload = entry.codec == RPK_CODEC_NONE ? *request->data : request->stored;
+					if (_reader.needsChecksum(entry)) request->status = _reader.checkPayload(entry, crc32c(0, payload.data(), payload.length()));
+					if (request->status == RPK_OK && entry.codec != RPK_CODEC_NONE
+						&& !compression::decodePayload(request->stored.data(), request->stored.length(), &(*request->data)[0], (std::size_t)entry.length)) {
+						RPK_ERROR("Couldn't decompress file from archive");
+						request->status = RPK_CORRUPT_ARCHIVE;
+					}
+				}
+				finish(request);
+			});
+		}
+#endif
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "ArchiveReader.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace rvn {
+	class ThreadPool;
+	// Outcome of an asynchronous read
+	struct AsyncResult {
+		std::uint64_t id = 0;
+		int status = RPK_OK;
+		std::shared_ptr<std::string> data;
+	};
+	using AsyncCallback = std::function<void(AsyncResult)>;
+	struct AsyncOptions {
+		// Reads in flight at once. The thread pool fallback uses at most two threads per core,
+		// requests beyond that wait in its queue
+		std::size_t queueDepth = 64;
+		// io_uring on Linux if the kernel allows it, otherwise a pread thread pool
+		bool useIoUring = true;
+	};
+	// Reads whole files of an archive in the background. Submitting never blocks, results come back
+	// through callbacks or futures as the reads complete. On Linux the reads are batched through
+	// io_uring, elsewhere or if io_uring is unavailable a pool of threads issues preads.
+	// The ArchiveReader has to stay open while the AsyncReader exists. Callbacks run on an
+	// internal thread and should return quickly
+	class AsyncReader {
+	public:
+		explicit AsyncReader(const ArchiveReader& reader, const AsyncOptions& options = AsyncOptions());
+		// Cancels everything still pending and waits for it
+		~AsyncReader();
+		AsyncReader(const AsyncReader&) = delete;
+		AsyncReader& operator=(const AsyncReader&) = delete;
+
+		// Queues a read of a whole file and returns its id
+		std::uint64_t submit(const std::string& filePath, AsyncCallback callback);
+		std::pair<std::uint64_t, std::future<AsyncResult>> submit(const std::string& filePath);
+		// Completes a request with RPK_CANCELLED if it hasn't completed yet, returns whether it was still pending
+		bool cancel(std::uint64_t id);
+		void cancelAll();
+		// Blocks until every request submitted so far has completed
+		void wait();
+		bool usesIoUring() const { return _ring != nullptr; }
+	private:
+		struct Request;
+		struct Ring;
+		std::uint64_t enqueue(const std::string& filePath, AsyncCallback callback);
+		void finish(const std::shared_ptr<Request>& request);
+		void runRing();
+
+		const ArchiveReader& _reader;
+		AsyncOptions _options;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::condition_variable _idle;
+		// Every request that hasn't completed yet
+		std::unordered_map<std::uint64_t, std::shared_ptr<Request>> _requests;
+		// Requests the ring hasn't started yet
+		std::deque<std::shared_ptr<Request>> _queue;
+		std::uint64_t _nextId = 1;
+		bool _stopping = false;
+		std::unique_ptr<Ring> _ring;
+		std::thread _ringThread;
+		std::unique_ptr<ThreadPool> _pool;
+	};
+}
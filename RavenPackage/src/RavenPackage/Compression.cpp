@@ -0,0 +1,308 @@
+#include "Compression.h"
+
+#include <cstring>
+#include <vector>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+// Self-contained implementation of the LZ4 block format
+// Sequences: token (literal length << 4 | match length - 4), literal length bytes, literals,
+// offset (2), match length bytes. The last sequence only has literals.
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_RUN_MASK 15
+#define LZ4_ML_MASK 15
+#define LZ4_HASH_LOG 16
+#define LZ4_SKIP_TRIGGER 6
+
+namespace rvn {
+	namespace {
+		inline std::uint32_t read32(const char* p)
+		{
+			std::uint32_t value;
+			std::memcpy(&value, p, 4);
+			return value;
+		}
+		inline std::uint64_t read64(const char* p)
+		{
+			std::uint64_t value;
+			std::memcpy(&value, p, 8);
+			return value;
+		}
+		inline std::uint32_t hash4(std::uint32_t sequence, unsigned hashLog)
+		{
+			return (sequence * 2654435761u) >> (32 - hashLog);
+		}
+		inline unsigned countTrailingZeros(std::uint64_t value)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward64(&index, value);
+			return (unsigned)index;
+#else
+			return (unsigned)__builtin_ctzll(value);
+#endif
+		}
+		// Number of equal bytes at a and b, b is never read past limit
+		inline std::size_t countMatch(const char* a, const char* b, const char* limit)
+		{
+			const char* start = b;
+			while (b + 8 <= limit) {
+				std::uint64_t diff = read64(a) ^ read64(b);
+				if (diff) return (std::size_t)(b - start) + (countTrailingZeros(diff) >> 3);
+				a += 8;
+				b += 8;
+			}
+			while (b < limit && *a == *b) {
+				a++;
+				b++;
+			}
+			return (std::size_t)(b - start);
+		}
+		// Chain depth for every level, level 1 only looks at the last occurrence
+		int getAttempts(int level)
+		{
+			static const int attempts[] = { 1, 1, 4, 8, 16, 32, 64, 128, 256, 1024 };
+			if (level < RPK_COMPRESSION_LEVEL_MIN) level = RPK_COMPRESSION_LEVEL_MIN;
+			if (level > RPK_COMPRESSION_LEVEL_MAX) level = RPK_COMPRESSION_LEVEL_MAX;
+			return attempts[level];
+		}
+		inline bool writeLength(char*& op, const char* end, std::size_t length)
+		{
+			while (length >= 255) {
+				if (op >= end) return false;
+				*op++ = (char)255;
+				length -= 255;
+			}
+			if (op >= end) return false;
+			*op++ = (char)length;
+			return true;
+		}
+		bool writeSequence(char*& op, const char* end, const char* literals, std::size_t literalLength, std::size_t offset, std::size_t matchLength)
+		{
+			if (op >= end) return false;
+			char* token = op++;
+			std::size_t matchCode = matchLength - LZ4_MIN_MATCH;
+			*token = (char)(((literalLength >= LZ4_RUN_MASK ? LZ4_RUN_MASK : literalLength) << 4)
+				| (matchCode >= LZ4_ML_MASK ? LZ4_ML_MASK : matchCode));
+			if (literalLength >= LZ4_RUN_MASK && !writeLength(op, end, literalLength - LZ4_RUN_MASK)) return false;
+			if ((std::size_t)(end - op) < literalLength + 2) return false;
+			std::memcpy(op, literals, literalLength);
+			op += literalLength;
+			*op++ = (char)(offset & 0xFF);
+			*op++ = (char)(offset >> 8);
+			if (matchCode >= LZ4_ML_MASK && !writeLength(op, end, matchCode - LZ4_ML_MASK)) return false;
+			return true;
+		}
+		bool writeLastLiterals(char*& op, const char* end, const char* literals, std::size_t literalLength)
+		{
+			if (op >= end) return false;
+			*op++ = (char)((literalLength >= LZ4_RUN_MASK ? LZ4_RUN_MASK : literalLength) << 4);
+			if (literalLength >= LZ4_RUN_MASK && !writeLength(op, end, literalLength - LZ4_RUN_MASK)) return false;
+			if ((std::size_t)(end - op) < literalLength) return false;
+			std::memcpy(op, literals, literalLength);
+			op += literalLength;
+			return true;
+		}
+	}
+	std::size_t compression::getBound(std::size_t length)
+	{
+		return length + length / 255 + 16;
+	}
+	std::size_t compression::compress(const char* src, std::size_t srcLength, char* dst, std::size_t dstCapacity, int level)
+	{
+		if (srcLength > INT32_MAX) return 0;
+		// Match finder tables are reused by every call on the same thread, small inputs only clear a part of them
+		thread_local std::vector<std::int32_t> head;
+		thread_local std::vector<std::int32_t> chain;
+		const int attempts = getAttempts(level);
+		unsigned hashLog = LZ4_HASH_LOG;
+		while (hashLog > 10 && ((std::size_t)1 << (hashLog - 2)) > srcLength) hashLog--;
+		head.assign((std::size_t)1 << hashLog, -1);
+		std::size_t chainMask = 0;
+		if (attempts > 1) {
+			std::size_t chainSize = 1;
+			while (chainSize < srcLength && chainSize <= LZ4_MAX_DISTANCE) chainSize <<= 1;
+			chain.assign(chainSize, -1);
+			chainMask = chainSize - 1;
+		}
+
+		char* op = dst;
+		const char* end = dst + dstCapacity;
+		std::size_t anchor = 0;
+		std::size_t ip = 0;
+		const std::size_t matchLimit = srcLength > LZ4_LAST_LITERALS ? srcLength - LZ4_LAST_LITERALS : 0;
+		auto insert = [&](std::size_t pos) {
+			std::uint32_t h = hash4(read32(src + pos), hashLog);
+			if (attempts > 1) chain[pos & chainMask] = head[h];
+			head[h] = (std::int32_t)pos;
+		};
+		while (ip + LZ4_MF_LIMIT < srcLength) {
+			std::int32_t candidate = head[hash4(read32(src + ip), hashLog)];
+			insert(ip);
+			std::size_t bestLength = 0;
+			std::size_t bestMatch = 0;
+			for (int attempt = 0; attempt < attempts && candidate >= 0 && ip - (std::size_t)candidate <= LZ4_MAX_DISTANCE; attempt++) {
+				std::size_t match = (std::size_t)candidate;
+				if (read32(src + match) == read32(src + ip)) {
+					std::size_t length = LZ4_MIN_MATCH + countMatch(src + match + LZ4_MIN_MATCH, src + ip + LZ4_MIN_MATCH, src + matchLimit);
+					if (length > bestLength) {
+						bestLength = length;
+						bestMatch = match;
+					}
+				}
+				if (attempts == 1) break;
+				std::int32_t previous = chain[match & chainMask];
+				if (previous >= candidate) break;
+				candidate = previous;
+			}
+			if (bestLength < LZ4_MIN_MATCH) {
+				// Incompressible data is skipped faster at the lowest level
+				ip += attempts == 1 ? 1 + ((ip - anchor) >> LZ4_SKIP_TRIGGER) : 1;
+				continue;
+			}
+			while (ip > anchor && bestMatch > 0 && src[ip - 1] == src[bestMatch - 1]) {
+				ip--;
+				bestMatch--;
+				bestLength++;
+			}
+			if (!writeSequence(op, end, src + anchor, ip - anchor, ip - bestMatch, bestLength)) return 0;
+			std::size_t matchEnd = ip + bestLength;
+			if (attempts > 1) {
+				for (std::size_t pos = ip + 1; pos < matchEnd && pos + LZ4_MF_LIMIT < srcLength; pos++) insert(pos);
+			}
+			else if (matchEnd >= 2 && matchEnd - 2 > ip && matchEnd - 2 + LZ4_MF_LIMIT < srcLength) {
+				insert(matchEnd - 2);
+			}
+			ip = matchEnd;
+			anchor = ip;
+		}
+		if (!writeLastLiterals(op, end, src + anchor, srcLength - anchor)) return 0;
+		return (std::size_t)(op - dst);
+	}
+	bool compression::decompress(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		std::size_t ip = 0;
+		std::size_t op = 0;
+		for (;;) {
+			if (ip >= srcLength) return false;
+			const std::uint8_t token = (std::uint8_t)src[ip++];
+			std::size_t literalLength = token >> 4;
+			// Fast path for the common short sequence far away from both ends: fixed size copies only
+			if (literalLength < LZ4_RUN_MASK && (token & LZ4_ML_MASK) < LZ4_ML_MASK
+				&& srcLength - ip >= 32 && dstLength - op >= 40) {
+				std::memcpy(dst + op, src + ip, 16);
+				ip += literalLength;
+				op += literalLength;
+				const std::size_t offset = (std::uint8_t)src[ip] | ((std::size_t)(std::uint8_t)src[ip + 1] << 8);
+				if (offset >= 8 && offset <= op) {
+					ip += 2;
+					char* out = dst + op;
+					const char* match = out - offset;
+					std::memcpy(out, match, 8);
+					std::memcpy(out + 8, match + 8, 8);
+					std::memcpy(out + 16, match + 16, 2);
+					op += (token & LZ4_ML_MASK) + LZ4_MIN_MATCH;
+					continue;
+				}
+				// Overlapping or invalid match, undo and take the careful path
+				ip -= literalLength;
+				op -= literalLength;
+			}
+			if (literalLength == LZ4_RUN_MASK) {
+				std::uint8_t b;
+				do {
+					if (ip >= srcLength) return false;
+					b = (std::uint8_t)src[ip++];
+					literalLength += b;
+				} while (b == 255);
+			}
+			if (literalLength > srcLength - ip || literalLength > dstLength - op) return false;
+			// Short literal runs away from the ends are copied with one fixed size copy
+			if (literalLength <= 16 && srcLength - ip >= 16 && dstLength - op >= 16) std::memcpy(dst + op, src + ip, 16);
+			else std::memcpy(dst + op, src + ip, literalLength);
+			ip += literalLength;
+			op += literalLength;
+			if (ip == srcLength) break;
+
+			if (srcLength - ip < 2) return false;
+			const std::size_t offset = (std::uint8_t)src[ip] | ((std::size_t)(std::uint8_t)src[ip + 1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > op) return false;
+			std::size_t matchLength = token & LZ4_ML_MASK;
+			if (matchLength == LZ4_ML_MASK) {
+				std::uint8_t b;
+				do {
+					if (ip >= srcLength) return false;
+					b = (std::uint8_t)src[ip++];
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += LZ4_MIN_MATCH;
+			if (matchLength > dstLength - op) return false;
+			char* out = dst + op;
+			const char* match = out - offset;
+			if (offset >= 8 && dstLength - op >= matchLength + 8) {
+				// Copies of 8 bytes never overlap within themselves, the last one may write past the
+				// match into space that is overwritten later anyway
+				for (std::size_t i = 0; i < matchLength; i += 8) std::memcpy(out + i, match + i, 8);
+			}
+			else if (offset >= 8) {
+				std::size_t i = 0;
+				for (; i + 8 <= matchLength; i += 8) std::memcpy(out + i, match + i, 8);
+				for (; i < matchLength; i++) out[i] = match[i];
+			}
+			else {
+				for (std::size_t i = 0; i < matchLength; i++) out[i] = match[i];
+			}
+			op += matchLength;
+		}
+		return op == dstLength;
+	}
+	bool compression::encodeChunk(const char* src, std::size_t length, std::string& out, int level)
+	{
+		std::size_t headerPos = out.length();
+		out.resize(headerPos + RPK_COMPRESSION_CHUNK_HEADER_LENGTH + getBound(length));
+		std::size_t compressed = compress(src, length, &out[headerPos + RPK_COMPRESSION_CHUNK_HEADER_LENGTH], getBound(length), level);
+		std::uint32_t header;
+		if (compressed == 0 || compressed >= length) {
+			std::memcpy(&out[headerPos + RPK_COMPRESSION_CHUNK_HEADER_LENGTH], src, length);
+			compressed = length;
+			header = (std::uint32_t)length | RPK_COMPRESSION_CHUNK_STORED;
+		}
+		else {
+			header = (std::uint32_t)compressed;
+		}
+		for (int i = 0; i < 4; i++) out[headerPos + i] = (char)((header >> (i * 8)) & 0xFF);
+		out.resize(headerPos + RPK_COMPRESSION_CHUNK_HEADER_LENGTH + compressed);
+		return !(header & RPK_COMPRESSION_CHUNK_STORED);
+	}
+	bool compression::decodePayload(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength)
+	{
+		std::size_t ip = 0;
+		std::size_t op = 0;
+		while (op < dstLength) {
+			if (srcLength - ip < RPK_COMPRESSION_CHUNK_HEADER_LENGTH) return false;
+			std::uint32_t header = 0;
+			for (int i = 3; i >= 0; i--) header = (header << 8) | (std::uint8_t)src[ip + i];
+			ip += RPK_COMPRESSION_CHUNK_HEADER_LENGTH;
+			std::size_t stored = header & ~RPK_COMPRESSION_CHUNK_STORED;
+			std::size_t length = dstLength - op < RPK_COMPRESSION_CHUNK_SIZE ? dstLength - op : RPK_COMPRESSION_CHUNK_SIZE;
+			if (stored > srcLength - ip) return false;
+			if (header & RPK_COMPRESSION_CHUNK_STORED) {
+				if (stored != length) return false;
+				std::memcpy(dst + op, src + ip, length);
+			}
+			else if (!decompress(src + ip, stored, dst + op, length)) {
+				return false;
+			}
+			ip += stored;
+			op += length;
+		}
+		return ip == srcLength;
+	}
+}
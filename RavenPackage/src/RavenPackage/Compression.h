@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Codecs
+#define RPK_CODEC_NONE 0
+// LZ4 block format
+#define RPK_CODEC_LZ4 1
+
+// Compression levels, higher levels search longer for matches
+#define RPK_COMPRESSION_LEVEL_MIN 1
+#define RPK_COMPRESSION_LEVEL_DEFAULT 1
+#define RPK_COMPRESSION_LEVEL_MAX 9
+
+// Compressed payloads are a sequence of chunks that can be decoded on their own.
+// Every chunk starts with a header (4) containing its stored length, the highest bit is set
+// if the chunk didn't shrink and is stored as is. All chunks except the last one
+// decompress to RPK_COMPRESSION_CHUNK_SIZE bytes.
+#define RPK_COMPRESSION_CHUNK_SIZE 262144
+#define RPK_COMPRESSION_CHUNK_HEADER_LENGTH 4
+#define RPK_COMPRESSION_CHUNK_STORED 0x80000000u
+
+namespace rvn {
+	// Codec and level for a file
+	struct Compression {
+		Compression() = default;
+		Compression(std::uint8_t codec, int level = RPK_COMPRESSION_LEVEL_DEFAULT)
+			: codec(codec), level(level)
+		{}
+		std::uint8_t codec = RPK_CODEC_NONE;
+		int level = RPK_COMPRESSION_LEVEL_DEFAULT;
+	};
+	struct compression {
+		// Largest possible compressed length of a block
+		static std::size_t getBound(std::size_t length);
+		// Compresses a block, returns the compressed length or 0 if it doesn't fit into dst
+		static std::size_t compress(const char* src, std::size_t srcLength, char* dst, std::size_t dstCapacity, int level);
+		// Decompresses a block that has to decompress to exactly dstLength bytes
+		static bool decompress(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength);
+
+		// Appends a chunk with its header to out, falls back to storing it if it doesn't shrink.
+		// Returns whether the chunk was compressed
+		static bool encodeChunk(const char* src, std::size_t length, std::string& out, int level);
+		// Decodes a whole chunked payload into dst
+		static bool decodePayload(const char* src, std::size_t srcLength, char* dst, std::size_t dstLength);
+	};
+}
@@ -0,0 +1,147 @@
+#include "DirectoryScanner.h"
+#include "RavenPackage.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace rvn {
+	namespace {
+		// Directories waiting to be read, one queue per thread. The owner takes the newest directory from the back,
+		// thieves take the oldest from the front, which is usually the root of the largest subtree nobody has touched.
+		// Threads without work sleep until a directory is queued or the scan is over
+		class ScanQueues {
+		public:
+			explicit ScanQueues(std::size_t count)
+				: _queues(count)
+			{}
+			void push(std::size_t worker, ScannedDirectory* directory)
+			{
+				// Counted before it is visible, so pending can't reach 0 while a directory is still queued
+				_pending++;
+				_queued++;
+				{
+					std::lock_guard<std::mutex> lock(_queues[worker].mutex);
+					_queues[worker].directories.push_back(directory);
+				}
+				// Sleepers check _queued under this lock, taking it orders the notification after their check
+				{
+					std::lock_guard<std::mutex> lock(_sleepMutex);
+				}
+				_available.notify_one();
+			}
+			// The next directory for worker, nullptr once every directory is read or the scan stopped
+			ScannedDirectory* wait(std::size_t worker)
+			{
+				for (;;) {
+					if (ScannedDirectory* directory = pop(worker)) return directory;
+					std::unique_lock<std::mutex> lock(_sleepMutex);
+					_available.wait(lock, [this]() { return _queued > 0 || _pending == 0 || _stopped; });
+					if (_pending == 0 || _stopped) return nullptr;
+				}
+			}
+			// Called after a directory is read and its subdirectories are pushed
+			void finish()
+			{
+				if (--_pending == 0) wakeAll();
+			}
+			// Ends the scan early, queued directories are dropped
+			void stop()
+			{
+				_stopped = true;
+				wakeAll();
+			}
+		private:
+			ScannedDirectory* pop(std::size_t worker)
+			{
+				for (std::size_t i = 0; i < _queues.size(); i++) {
+					Queue& queue = _queues[(worker + i) % _queues.size()];
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					if (queue.directories.empty()) continue;
+					ScannedDirectory* directory;
+					if (i == 0) {
+						directory = queue.directories.back();
+						queue.directories.pop_back();
+					}
+					else {
+						directory = queue.directories.front();
+						queue.directories.pop_front();
+					}
+					_queued--;
+					return directory;
+				}
+				return nullptr;
+			}
+			void wakeAll()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_sleepMutex);
+				}
+				_available.notify_all();
+			}
+
+			struct Queue {
+				std::mutex mutex;
+				std::deque<ScannedDirectory*> directories;
+			};
+			std::vector<Queue> _queues;
+			// Directories queued or being read
+			std::atomic<std::size_t> _pending{ 0 };
+			// Directories in the queues
+			std::atomic<std::size_t> _queued{ 0 };
+			std::atomic<bool> _stopped{ false };
+			std::mutex _sleepMutex;
+			std::condition_variable _available;
+		};
+	}
+
+	int scanDirectory(const std::string& dirPath, std::size_t threads, ScannedDirectory& root)
+	{
+		root = ScannedDirectory();
+		threads = ThreadPool::resolveThreadCount(threads);
+		ScanQueues queues(threads);
+		queues.push(0, &root);
+		std::atomic<std::size_t> nextWorker{ 0 };
+		std::atomic<int> status{ RPK_OK };
+		ThreadPool::run(threads, threads, [&]() {
+			const std::size_t worker = nextWorker++;
+			std::vector<platform::DirectoryItem> items;
+			while (ScannedDirectory* directory = queues.wait(worker)) {
+				const std::string diskPath = directory->path.empty() ? dirPath : dirPath + '/' + directory->path;
+				items.clear();
+				if (!platform::listDirectory(diskPath, items)) {
+					RPK_ERROR("Couldn't read directory '" + diskPath + "'");
+					int expected = RPK_OK;
+					status.compare_exchange_strong(expected, RPK_COULDNT_OPEN_FILE);
+					queues.stop();
+					break;
+				}
+				std::sort(items.begin(), items.end(), [](const platform::DirectoryItem& a, const platform::DirectoryItem& b) {
+					return a.name < b.name;
+				});
+				const std::size_t directoryCount = (std::size_t)std::count_if(items.begin(), items.end(), [](const platform::DirectoryItem& item) {
+					return item.isDirectory;
+				});
+				// Sized once, the queued pointers into it stay valid
+				directory->directories.resize(directoryCount);
+				directory->files.reserve(items.size() - directoryCount);
+				const std::string prefix = directory->path.empty() ? "" : directory->path + '/';
+				std::size_t next = 0;
+				for (auto& item : items) {
+					if (!item.isDirectory) {
+						directory->files.push_back(std::move(item));
+						continue;
+					}
+					ScannedDirectory& child = directory->directories[next++];
+					child.path = prefix + item.name;
+					if (!item.isLink) queues.push(worker, &child);
+				}
+				queues.finish();
+			}
+		});
+		return status;
+	}
+}
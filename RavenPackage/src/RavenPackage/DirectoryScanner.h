@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace rvn {
+	// A directory found by scanDirectory
+	struct ScannedDirectory {
+		// Relative to the scanned directory with '/' separators, empty for the scanned directory itself
+		std::string path;
+		// Regular files with their sizes, sorted by name
+		std::vector<platform::DirectoryItem> files;
+		// Sorted by name. Linked directories are listed but stay empty, so a link can't send the scan in circles
+		std::vector<ScannedDirectory> directories;
+	};
+	// Lists everything below dirPath into root on up to threads threads, 0 uses one per core. Every directory
+	// is read with a single platform::listDirectory and every file stat'ed once. Each thread works depth first
+	// through its own queue of directories and steals from the other end of another queue when its own runs
+	// dry, so deep and wide trees are both spread over all threads. The result is sorted and doesn't depend
+	// on the thread count. RPK_COULDNT_OPEN_FILE if a directory can't be read
+	int scanDirectory(const std::string& dirPath, std::size_t threads, ScannedDirectory& root);
+}
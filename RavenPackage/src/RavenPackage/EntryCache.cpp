@@ -0,0 +1,74 @@
+#include "EntryCache.h"
+#include "Metrics.h"
+
+#include <algorithm>
+
+// Upper limit for the shards, each one gets at least RPK_CACHE_MIN_SHARD_BUDGET bytes
+#define RPK_CACHE_MAX_SHARDS 16
+#define RPK_CACHE_MIN_SHARD_BUDGET 4194304
+
+namespace rvn {
+	EntryCache::EntryCache(std::size_t byteBudget, std::size_t shardCount)
+		: _budget(byteBudget)
+	{
+		if (shardCount == 0) shardCount = std::clamp<std::size_t>(byteBudget / RPK_CACHE_MIN_SHARD_BUDGET, 1, RPK_CACHE_MAX_SHARDS);
+		_shardBudget = byteBudget / shardCount;
+		_shards.reserve(shardCount);
+		for (std::size_t i = 0; i < shardCount; i++) _shards.push_back(std::make_unique<Shard>());
+	}
+	std::shared_ptr<const std::string> EntryCache::get(std::uint32_t key)
+	{
+		Shard& shard = getShard(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			shard.stats.misses++;
+			metrics::add(metrics::Counter::CacheMisses);
+			return nullptr;
+		}
+		shard.stats.hits++;
+		metrics::add(metrics::Counter::CacheHits);
+		shard.order.splice(shard.order.begin(), shard.order, it->second);
+		return it->second->second;
+	}
+	void EntryCache::put(std::uint32_t key, std::shared_ptr<const std::string> data)
+	{
+		if (!data || data->length() > _shardBudget) return;
+		Shard& shard = getShard(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		// Another thread might have cached it in the meantime
+		if (shard.index.count(key)) return;
+		shard.bytes += data->length();
+		shard.order.emplace_front(key, std::move(data));
+		shard.index.emplace(key, shard.order.begin());
+		while (shard.bytes > _shardBudget) {
+			auto& last = shard.order.back();
+			shard.bytes -= last.second->length();
+			shard.index.erase(last.first);
+			shard.order.pop_back();
+			shard.stats.evictions++;
+		}
+	}
+	void EntryCache::clear()
+	{
+		for (auto& shard : _shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			shard->order.clear();
+			shard->index.clear();
+			shard->bytes = 0;
+		}
+	}
+	CacheStats EntryCache::getStats() const
+	{
+		CacheStats ret;
+		for (auto& shard : _shards) {
+			std::lock_guard<std::mutex> lock(shard->mutex);
+			ret.hits += shard->stats.hits;
+			ret.misses += shard->stats.misses;
+			ret.evictions += shard->stats.evictions;
+			ret.bytes += shard->bytes;
+			ret.entries += shard->order.size();
+		}
+		return ret;
+	}
+}
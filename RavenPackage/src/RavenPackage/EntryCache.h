@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rvn {
+	struct CacheStats {
+		std::uint64_t hits = 0;
+		std::uint64_t misses = 0;
+		std::uint64_t evictions = 0;
+		// Decoded bytes and files currently held
+		std::uint64_t bytes = 0;
+		std::uint64_t entries = 0;
+	};
+	// Byte bounded LRU cache of decoded files. Keys are spread over shards that each have their own
+	// lock and their own part of the budget, so threads reading different files rarely wait on
+	// each other. Cached buffers are immutable and stay valid for whoever holds them after eviction
+	class EntryCache {
+	public:
+		// 0 shards picks a count from the budget
+		explicit EntryCache(std::size_t byteBudget, std::size_t shardCount = 0);
+		EntryCache(const EntryCache&) = delete;
+		EntryCache& operator=(const EntryCache&) = delete;
+
+		// nullptr on a miss
+		std::shared_ptr<const std::string> get(std::uint32_t key);
+		// Files bigger than a shard's budget are not cached
+		void put(std::uint32_t key, std::shared_ptr<const std::string> data);
+		void clear();
+		std::size_t getBudget() const { return _budget; }
+		CacheStats getStats() const;
+	private:
+		struct Shard {
+			std::mutex mutex;
+			// Most recently used first
+			std::list<std::pair<std::uint32_t, std::shared_ptr<const std::string>>> order;
+			std::unordered_map<std::uint32_t, decltype(order)::iterator> index;
+			std::size_t bytes = 0;
+			CacheStats stats;
+		};
+		Shard& getShard(std::uint32_t key) { return *_shards[key % _shards.size()]; }
+
+		std::size_t _budget = 0;
+		std::size_t _shardBudget = 0;
+		std::vector<std::unique_ptr<Shard>> _shards;
+	};
+}
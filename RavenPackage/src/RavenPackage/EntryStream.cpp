@@ -0,0 +1,128 @@
+#include "EntryStream.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace rvn {
+	std::size_t EntryStream::read(std::uint64_t offset, std::size_t length, char* dst) const
+	{
+		if (_status != RPK_OK || offset >= _length) return 0;
+		length = (std::size_t)std::min<std::uint64_t>(length, _length - offset);
+		if (_memory) {
+			std::memcpy(dst, _memory->data() + _begin + offset, length);
+			return length;
+		}
+		if (_codec == RPK_CODEC_NONE) return _file->readAt(_begin + offset, dst, length);
+		std::size_t done = 0;
+		while (done < length) {
+			const std::uint64_t position = offset + done;
+			const std::size_t within = (std::size_t)(position % RPK_COMPRESSION_CHUNK_SIZE);
+			std::shared_ptr<const std::string> chunk = getChunk((std::size_t)(position / RPK_COMPRESSION_CHUNK_SIZE));
+			if (!chunk) break;
+			std::size_t count = std::min(length - done, chunk->length() - within);
+			std::memcpy(dst + done, chunk->data() + within, count);
+			done += count;
+		}
+		return done;
+	}
+	std::size_t EntryStream::read(std::size_t length, char* dst)
+	{
+		std::size_t count = read(_position, length, dst);
+		_position += count;
+		return count;
+	}
+	std::shared_ptr<const std::string> EntryStream::getChunk(std::size_t index) const
+	{
+		{
+			std::lock_guard<std::mutex> lock(_cache->mutex);
+			if (_cache->index == index) return _cache->data;
+		}
+		if (index + 1 >= _chunks.size()) return nullptr;
+		// Decoding happens outside the lock, so threads reading different chunks don't wait on each other
+		const std::size_t stored = (std::size_t)(_chunks[index + 1] - _chunks[index]);
+		const std::size_t length = (std::size_t)std::min<std::uint64_t>(RPK_COMPRESSION_CHUNK_SIZE,
+			_length - (std::uint64_t)index * RPK_COMPRESSION_CHUNK_SIZE);
+		std::string source(stored, 0x00);
+		auto data = std::make_shared<std::string>(length, 0x00);
+		if (_file->readAt(_chunks[index], &source[0], stored) != stored
+			|| !compression::decodePayload(source.data(), stored, &(*data)[0], length)) {
+			RPK_ERROR("Couldn't decompress file from archive");
+			return nullptr;
+		}
+		std::lock_guard<std::mutex> lock(_cache->mutex);
+		_cache->index = index;
+		_cache->data = data;
+		return data;
+	}
+
+	EntryStreamBuffer::EntryStreamBuffer(EntryStream stream, std::size_t bufferSize)
+		: _stream(std::move(stream)), _buffer(std::max<std::size_t>(bufferSize, 1), 0x00)
+	{
+		setg(&_buffer[0], &_buffer[0], &_buffer[0]);
+	}
+	EntryStreamBuffer::int_type EntryStreamBuffer::underflow()
+	{
+		if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+		_bufferOffset += egptr() - eback();
+		std::size_t count = _stream.read(_bufferOffset, _buffer.length(), &_buffer[0]);
+		setg(&_buffer[0], &_buffer[0], &_buffer[0] + count);
+		if (count == 0) return traits_type::eof();
+		return traits_type::to_int_type(*gptr());
+	}
+	std::streamsize EntryStreamBuffer::xsgetn(char* dst, std::streamsize count)
+	{
+		// Serves what is buffered, larger remainders are read straight into dst
+		std::streamsize done = std::min<std::streamsize>(count, egptr() - gptr());
+		std::memcpy(dst, gptr(), (std::size_t)done);
+		gbump((int)done);
+		if (done == count) return done;
+		if (count - done < (std::streamsize)_buffer.length()) {
+			while (done < count && underflow() != traits_type::eof()) {
+				std::streamsize part = std::min<std::streamsize>(count - done, egptr() - gptr());
+				std::memcpy(dst + done, gptr(), (std::size_t)part);
+				gbump((int)part);
+				done += part;
+			}
+			return done;
+		}
+		const std::uint64_t position = _bufferOffset + (egptr() - eback());
+		const std::size_t direct = _stream.read(position, (std::size_t)(count - done), dst + done);
+		_bufferOffset = position + direct;
+		setg(&_buffer[0], &_buffer[0], &_buffer[0]);
+		done += (std::streamsize)direct;
+		return done;
+	}
+	EntryStreamBuffer::pos_type EntryStreamBuffer::seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+		const std::int64_t current = (std::int64_t)(_bufferOffset + (gptr() - eback()));
+		std::int64_t base = 0;
+		if (dir == std::ios_base::cur) base = current;
+		else if (dir == std::ios_base::end) base = (std::int64_t)_stream.getLength();
+		return seekpos(pos_type(off_type(base + offset)), which);
+	}
+	EntryStreamBuffer::pos_type EntryStreamBuffer::seekpos(pos_type position, std::ios_base::openmode which)
+	{
+		const std::int64_t target = (std::int64_t)off_type(position);
+		if (!(which & std::ios_base::in) || target < 0 || (std::uint64_t)target > _stream.getLength())
+			return pos_type(off_type(-1));
+		// Seeks inside the buffer keep it, everything else refills on the next read
+		const std::uint64_t bufferEnd = _bufferOffset + (egptr() - eback());
+		if ((std::uint64_t)target >= _bufferOffset && (std::uint64_t)target < bufferEnd) {
+			setg(eback(), eback() + (target - (std::int64_t)_bufferOffset), egptr());
+		}
+		else {
+			metrics::add(metrics::Counter::Seeks);
+			_bufferOffset = (std::uint64_t)target;
+			setg(&_buffer[0], &_buffer[0], &_buffer[0]);
+		}
+		return position;
+	}
+
+	EntryIStream::EntryIStream(EntryStream stream)
+		: std::istream(nullptr), _streamBuffer(std::move(stream))
+	{
+		rdbuf(&_streamBuffer);
+		if (_streamBuffer.getStream().getStatus() != RPK_OK) setstate(std::ios_base::badbit);
+	}
+}
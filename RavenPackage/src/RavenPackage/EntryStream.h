@@ -0,0 +1,86 @@
+#pragma once
+
+#include "RavenPackage.h"
+#include "Platform.h"
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace rvn {
+	// Random access to one file of an archive without loading it as a whole. Reads are bounded
+	// by the file's payload and go through pread, so read(offset, ...) can be called from
+	// several threads at once. Compressed files are decoded one chunk at a time.
+	// The stream stays usable after the reader it came from is closed
+	class EntryStream {
+	public:
+		EntryStream() = default;
+
+		// RPK_OK if the stream can be read
+		int getStatus() const { return _status; }
+		// Length of the file after decompressing
+		std::uint64_t getLength() const { return _length; }
+
+		// Reads up to length bytes at offset, returns the number of bytes read.
+		// Less than length means the end of the file was reached or the archive is corrupt
+		std::size_t read(std::uint64_t offset, std::size_t length, char* dst) const;
+		// Reads at the current position and moves it forward, not safe to call from several threads
+		std::size_t read(std::size_t length, char* dst);
+		// Moves the current position, positions past the end are clamped to the end
+		void seek(std::uint64_t position)
+		{
+			metrics::add(metrics::Counter::Seeks);
+			_position = position < _length ? position : _length;
+		}
+		std::uint64_t getPosition() const { return _position; }
+	private:
+		// Last decoded chunk, shared by all copies of a stream
+		struct ChunkCache {
+			std::mutex mutex;
+			std::size_t index = SIZE_MAX;
+			std::shared_ptr<const std::string> data;
+		};
+		std::shared_ptr<const std::string> getChunk(std::size_t index) const;
+
+		int _status = RPK_INVALID_PATH;
+		std::shared_ptr<const platform::File> _file;
+		std::uint64_t _begin = 0;
+		std::uint64_t _end = 0;
+		std::uint64_t _length = 0;
+		std::uint8_t _codec = RPK_CODEC_NONE;
+		// Decoded solid block of the file, _begin is the offset inside
+		std::shared_ptr<const std::string> _memory;
+		// Offsets of the chunk headers of a compressed file, followed by the end of the last chunk
+		std::vector<std::uint64_t> _chunks;
+		std::shared_ptr<ChunkCache> _cache;
+		std::uint64_t _position = 0;
+		friend class ArchiveReader;
+	};
+	// Buffered std::streambuf over an EntryStream, supports seeking
+	class EntryStreamBuffer : public std::streambuf {
+	public:
+		explicit EntryStreamBuffer(EntryStream stream, std::size_t bufferSize = RPK_BUFFER_SIZE * 8);
+		const EntryStream& getStream() const { return _stream; }
+	protected:
+		int_type underflow() override;
+		std::streamsize xsgetn(char* dst, std::streamsize count) override;
+		pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+		pos_type seekpos(pos_type position, std::ios_base::openmode which) override;
+	private:
+		EntryStream _stream;
+		std::string _buffer;
+		// File offset of the first byte in _buffer
+		std::uint64_t _bufferOffset = 0;
+	};
+	// std::istream adapter, for code that already consumes streams
+	class EntryIStream : public std::istream {
+	public:
+		explicit EntryIStream(EntryStream stream);
+	private:
+		EntryStreamBuffer _streamBuffer;
+	};
+}
@@ -0,0 +1,171 @@
+#include "Format.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+
+namespace rvn {
+	namespace format {
+		std::string normalizePath(const std::string& path)
+		{
+			std::string out;
+			out.reserve(path.length());
+			bool separator = false;
+			for (char c : path) {
+				if (c == '/' || c == '\\') {
+					separator = !out.empty();
+					continue;
+				}
+				if (separator) {
+					out.push_back('/');
+					separator = false;
+				}
+				out.push_back(c);
+			}
+			return out;
+		}
+		bool isSafeName(std::string_view name)
+		{
+			if (name.empty() || name == "." || name == "..") return false;
+			if (name.find_first_of("/\\") != std::string_view::npos) return false;
+			return !(name.length() >= 2 && name[1] == ':' && std::isalpha((unsigned char)name[0]));
+		}
+		bool isSafePath(std::string_view path)
+		{
+			for (std::size_t begin = 0;;) {
+				const std::size_t end = path.find('/', begin);
+				if (!isSafeName(path.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin))) return false;
+				if (end == std::string_view::npos) return true;
+				begin = end + 1;
+			}
+		}
+		std::uint64_t hashPath(const char* path, std::size_t length)
+		{
+			std::uint64_t hash = 14695981039346656037ull;
+			for (std::size_t i = 0; i < length; i++) {
+				hash ^= (std::uint8_t)path[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+		std::uint32_t getSlotCount(std::size_t entryCount)
+		{
+			// Keeps the load factor at or below one half, so most lookups need a single probe
+			std::uint64_t slotCount = 16;
+			while (slotCount < (std::uint64_t)entryCount * 2) slotCount <<= 1;
+			return (std::uint32_t)slotCount;
+		}
+		std::string buildDirectory(const std::vector<Record>& records, std::uint32_t alignment, std::uint64_t alignmentThreshold,
+			const std::vector<Block>& blocks, const std::vector<std::string>& deletions)
+		{
+			const std::uint32_t slotCount = getSlotCount(records.size());
+			const bool aligned = alignment > 1;
+			std::string out;
+			appendUint32(out, (aligned ? RPK_V2_FLAG_ALIGNED : 0) | (blocks.empty() ? 0 : RPK_V2_FLAG_SOLID) | (deletions.empty() ? 0 : RPK_V2_FLAG_DELETIONS));
+			appendUint32(out, (std::uint32_t)records.size());
+			appendUint32(out, slotCount);
+			if (aligned) {
+				appendUint32(out, alignment);
+				appendUint64(out, alignmentThreshold);
+			}
+			if (!blocks.empty()) {
+				appendUint32(out, (std::uint32_t)blocks.size());
+				for (auto& block : blocks) {
+					out.push_back((char)block.traits);
+					appendUint64(out, block.begin);
+					appendUint64(out, block.end);
+					out.push_back((char)block.codec);
+					appendUint64(out, block.length);
+					appendUint32(out, block.checksum);
+				}
+			}
+			if (!deletions.empty()) {
+				appendUint32(out, (std::uint32_t)deletions.size());
+				for (auto& path : deletions) {
+					appendUint16(out, (std::uint16_t)path.length());
+					out += path;
+				}
+			}
+			// Entries are written sorted by path, so readers can answer prefix queries without sorting.
+			// A parent is a prefix of the paths below it and stays in front of them
+			std::vector<std::uint32_t> order(records.size());
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return records[a].path < records[b].path; });
+			std::vector<std::uint32_t> positions(records.size());
+			for (std::uint32_t i = 0; i < (std::uint32_t)order.size(); i++) positions[order[i]] = i;
+			// Children come after their parents, so walking backwards finishes every directory before its parent
+			std::vector<std::uint64_t> fileCounts(records.size(), 0), lengths(records.size(), 0);
+			for (std::size_t i = records.size(); i-- > 0;) {
+				const Record& record = records[i];
+				if (record.traits & RPK_TRAIT_IS_FILE) {
+					fileCounts[i] = 1;
+					lengths[i] = (record.traits & RPK_TRAIT_COMPRESSED) ? record.length : record.end - record.begin;
+				}
+				if (record.parent == RPK_V2_NO_PARENT) continue;
+				fileCounts[record.parent] += fileCounts[i];
+				lengths[record.parent] += lengths[i];
+			}
+			for (std::uint32_t index : order) {
+				const Record& record = records[index];
+				const bool isFile = record.traits & RPK_TRAIT_IS_FILE;
+				const std::uint8_t traits = isFile ? record.traits : record.traits | RPK_TRAIT_TOTALS;
+				const std::size_t recordStart = out.length();
+				appendUint16(out, 0);
+				out.push_back((char)traits);
+				appendUint32(out, record.parent == RPK_V2_NO_PARENT ? RPK_V2_NO_PARENT : positions[record.parent]);
+				appendUint16(out, (std::uint16_t)record.path.length());
+				out += record.path;
+				appendUint64(out, record.begin);
+				appendUint64(out, record.end);
+				if (record.traits & RPK_TRAIT_COMPRESSED) {
+					out.push_back((char)record.codec);
+					appendUint64(out, record.length);
+				}
+				if (record.traits & RPK_TRAIT_CHECKSUM) appendUint32(out, record.checksum);
+				if (record.traits & RPK_TRAIT_SOLID) appendUint32(out, record.block);
+				if (!isFile) {
+					appendUint64(out, fileCounts[index]);
+					appendUint64(out, lengths[index]);
+				}
+				const std::uint16_t recordLength = (std::uint16_t)(out.length() - recordStart - 2);
+				out[recordStart] = (char)(recordLength & 0xFF);
+				out[recordStart + 1] = (char)(recordLength >> 8);
+			}
+			struct Slot {
+				std::uint64_t hash = 0;
+				std::uint32_t index = RPK_V2_EMPTY_SLOT;
+			};
+			std::vector<Slot> slots(slotCount);
+			const std::uint32_t mask = slotCount - 1;
+			for (std::uint32_t i = 0; i < (std::uint32_t)records.size(); i++) {
+				const std::string& path = records[order[i]].path;
+				std::uint64_t hash = hashPath(path.data(), path.length());
+				std::uint32_t slot = (std::uint32_t)(hash & mask);
+				bool duplicate = false;
+				while (slots[slot].index != RPK_V2_EMPTY_SLOT) {
+					if (slots[slot].hash == hash && records[order[slots[slot].index]].path == path) {
+						duplicate = true;
+						break;
+					}
+					slot = (slot + 1) & mask;
+				}
+				if (!duplicate) slots[slot] = { hash, i };
+			}
+			for (auto& slot : slots) {
+				appendUint64(out, slot.hash);
+				appendUint32(out, slot.index);
+			}
+			return out;
+		}
+		std::string buildFooter(std::uint64_t directoryOffset, const std::string& directory)
+		{
+			std::string out;
+			appendUint64(out, directoryOffset);
+			appendUint64(out, directory.length());
+			appendUint64(out, RPK_V2_FOOTER_HAS_CHECKSUM | crc32c(0, directory.data(), directory.length()));
+			out += RPK_V2_FOOTER_MAGIC;
+			return out;
+		}
+	}
+}
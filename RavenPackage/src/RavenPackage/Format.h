@@ -0,0 +1,91 @@
+#pragma once
+
+#include "RavenPackage.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Helpers for encoding the version 2 central directory, shared by the writers and the reader
+namespace rvn {
+	namespace format {
+		inline void appendUint16(std::string& out, std::uint16_t value)
+		{
+			out.push_back((char)(value & 0xFF));
+			out.push_back((char)((value >> 8) & 0xFF));
+		}
+		inline void appendUint32(std::string& out, std::uint32_t value)
+		{
+			for (int i = 0; i < 4; i++) out.push_back((char)((value >> (i * 8)) & 0xFF));
+		}
+		inline void appendUint64(std::string& out, std::uint64_t value)
+		{
+			for (int i = 0; i < 8; i++) out.push_back((char)((value >> (i * 8)) & 0xFF));
+		}
+		inline std::uint16_t readUint16(const char* in)
+		{
+			return std::uint16_t((std::uint8_t)in[0] | ((std::uint16_t)(std::uint8_t)in[1] << 8));
+		}
+		inline std::uint32_t readUint32(const char* in)
+		{
+			std::uint32_t value = 0;
+			for (int i = 3; i >= 0; i--) value = (value << 8) | (std::uint8_t)in[i];
+			return value;
+		}
+		inline std::uint64_t readUint64(const char* in)
+		{
+			std::uint64_t value = 0;
+			for (int i = 7; i >= 0; i--) value = (value << 8) | (std::uint8_t)in[i];
+			return value;
+		}
+
+		// Converts backslashes, drops empty components and leading/trailing slashes
+		std::string normalizePath(const std::string& path);
+		// Whether one path component can be extracted below a directory: not empty, "." or "..", no separator
+		// and no drive ("C:"), which would make it an absolute path on Windows
+		bool isSafeName(std::string_view name);
+		// Whether every component of a normalized path is safe, so the path can't leave the directory it is extracted to
+		bool isSafePath(std::string_view path);
+		// FNV-1a over a normalized path, stored in the archive so it must never change
+		std::uint64_t hashPath(const char* path, std::size_t length);
+		// Number of hash slots for a certain number of entries, always a power of two
+		std::uint32_t getSlotCount(std::size_t entryCount);
+
+		// One entry of the central directory
+		struct Record {
+			std::string path;
+			std::uint32_t parent = RPK_V2_NO_PARENT;
+			std::uint8_t traits = 0;
+			std::uint64_t begin = 0;
+			std::uint64_t end = 0;
+			// RPK_TRAIT_COMPRESSED
+			std::uint8_t codec = RPK_CODEC_NONE;
+			std::uint64_t length = 0;
+			// RPK_TRAIT_CHECKSUM
+			std::uint32_t checksum = 0;
+			// RPK_TRAIT_SOLID, begin and end are inside the decoded block
+			std::uint32_t block = RPK_V2_NO_BLOCK;
+		};
+		// One solid block, its stored bytes are a compressed payload like the ones of single files
+		struct Block {
+			// RPK_TRAIT_CHECKSUM
+			std::uint8_t traits = 0;
+			std::uint64_t begin = 0;
+			std::uint64_t end = 0;
+			std::uint8_t codec = RPK_CODEC_NONE;
+			// Length after decoding
+			std::uint64_t length = 0;
+			std::uint32_t checksum = 0;
+		};
+		// Encodes the central directory, parents have to come before their children. The entries are
+		// written sorted by path, parent indices are adjusted to that order.
+		// An alignment above 1 sets RPK_V2_FLAG_ALIGNED and stores it with its threshold,
+		// blocks set RPK_V2_FLAG_SOLID and deletions RPK_V2_FLAG_DELETIONS. Directories get their RPK_TRAIT_TOTALS
+		// from the records below them
+		std::string buildDirectory(const std::vector<Record>& records, std::uint32_t alignment = 0, std::uint64_t alignmentThreshold = 0,
+			const std::vector<Block>& blocks = {}, const std::vector<std::string>& deletions = {});
+		// The footer carries the checksum of the encoded directory
+		std::string buildFooter(std::uint64_t directoryOffset, const std::string& directory);
+	}
+}
@@ -0,0 +1,283 @@
+#include "Hash.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+	#define RPK_CRC32C_SSE42
+	#include <nmmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	#define RPK_CRC32C_ARM
+	#include <arm_acle.h>
+#endif
+
+namespace rvn {
+	namespace {
+		const std::uint64_t PRIME1 = 11400714785074694791ull;
+		const std::uint64_t PRIME2 = 14029467366897019727ull;
+		const std::uint64_t PRIME3 = 1609587929392839161ull;
+		const std::uint64_t PRIME4 = 9650029242287828579ull;
+		const std::uint64_t PRIME5 = 2870177450012600261ull;
+
+		inline std::uint64_t rotateLeft(std::uint64_t value, int bits)
+		{
+			return (value << bits) | (value >> (64 - bits));
+		}
+		inline std::uint64_t read64(const unsigned char* in)
+		{
+			std::uint64_t value = 0;
+			for (int i = 7; i >= 0; i--) value = (value << 8) | in[i];
+			return value;
+		}
+		inline std::uint32_t read32(const unsigned char* in)
+		{
+			return (std::uint32_t)in[0] | ((std::uint32_t)in[1] << 8) | ((std::uint32_t)in[2] << 16) | ((std::uint32_t)in[3] << 24);
+		}
+		inline std::uint64_t round(std::uint64_t accumulator, std::uint64_t input)
+		{
+			accumulator += input * PRIME2;
+			return rotateLeft(accumulator, 31) * PRIME1;
+		}
+		inline std::uint64_t mergeRound(std::uint64_t hash, std::uint64_t accumulator)
+		{
+			hash ^= round(0, accumulator);
+			return hash * PRIME1 + PRIME4;
+		}
+
+		// Slicing by 8 over the reflected polynomial
+		struct CrcTables {
+			CrcTables()
+			{
+				for (std::uint32_t i = 0; i < 256; i++) {
+					std::uint32_t crc = i;
+					for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+					tables[0][i] = crc;
+				}
+				for (std::uint32_t i = 0; i < 256; i++) {
+					for (int table = 1; table < 8; table++) tables[table][i] = (tables[table - 1][i] >> 8) ^ tables[0][tables[table - 1][i] & 0xFF];
+				}
+			}
+			std::uint32_t tables[8][256];
+		};
+		std::uint32_t crc32cSoftware(std::uint32_t crc, const unsigned char* in, std::size_t length)
+		{
+			static const CrcTables crcTables;
+			const auto& t = crcTables.tables;
+			for (; length >= 8; in += 8, length -= 8) {
+				std::uint32_t low = read32(in) ^ crc;
+				std::uint32_t high = read32(in + 4);
+				crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+					^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+			}
+			for (; length > 0; in++, length--) crc = (crc >> 8) ^ t[0][(crc ^ *in) & 0xFF];
+			return crc;
+		}
+#if defined(RPK_CRC32C_SSE42) || defined(RPK_CRC32C_ARM)
+		// The crc32 instruction has a latency of three cycles, so the hardware path runs three
+		// independent streams over neighbouring blocks and combines them by shifting the earlier
+		// CRCs over the length of a block (multiplying by x^(8 * length) modulo the polynomial)
+		const std::size_t CRC_LONG_BLOCK = 8192;
+		const std::size_t CRC_SHORT_BLOCK = 256;
+		std::uint32_t gf2Times(const std::uint32_t* matrix, std::uint32_t vector)
+		{
+			std::uint32_t sum = 0;
+			for (; vector; vector >>= 1, matrix++) {
+				if (vector & 1) sum ^= *matrix;
+			}
+			return sum;
+		}
+		void gf2Square(std::uint32_t* square, const std::uint32_t* matrix)
+		{
+			for (int n = 0; n < 32; n++) square[n] = gf2Times(matrix, matrix[n]);
+		}
+		struct CrcShift {
+			explicit CrcShift(std::size_t length)
+			{
+				// Operator for one zero bit, squared until it covers length zero bytes
+				std::uint32_t even[32], odd[32];
+				odd[0] = 0x82F63B78;
+				for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+				gf2Square(even, odd);
+				gf2Square(odd, even);
+				const std::uint32_t* op = odd;
+				for (;;) {
+					gf2Square(even, odd);
+					length >>= 1;
+					op = even;
+					if (length == 0) break;
+					gf2Square(odd, even);
+					length >>= 1;
+					op = odd;
+					if (length == 0) break;
+				}
+				for (std::uint32_t n = 0; n < 256; n++) {
+					for (int byte = 0; byte < 4; byte++) tables[byte][n] = gf2Times(op, n << (byte * 8));
+				}
+			}
+			std::uint32_t operator()(std::uint32_t crc) const
+			{
+				return tables[0][crc & 0xFF] ^ tables[1][(crc >> 8) & 0xFF] ^ tables[2][(crc >> 16) & 0xFF] ^ tables[3][crc >> 24];
+			}
+			std::uint32_t tables[4][256];
+		};
+#endif
+#if defined(RPK_CRC32C_SSE42)
+	#ifndef _MSC_VER
+		__attribute__((target("sse4.2")))
+	#endif
+		std::uint64_t crcStep(std::uint64_t crc, const unsigned char* in)
+		{
+			std::uint64_t value;
+			std::memcpy(&value, in, 8);
+			return _mm_crc32_u64(crc, value);
+		}
+	#ifndef _MSC_VER
+		__attribute__((target("sse4.2")))
+	#endif
+		std::uint32_t crcByte(std::uint32_t crc, unsigned char in)
+		{
+			return _mm_crc32_u8(crc, in);
+		}
+		bool hasHardwareCrc()
+		{
+	#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 20)) != 0;
+	#else
+			return __builtin_cpu_supports("sse4.2");
+	#endif
+		}
+#elif defined(RPK_CRC32C_ARM)
+		inline std::uint64_t crcStep(std::uint64_t crc, const unsigned char* in)
+		{
+			std::uint64_t value;
+			std::memcpy(&value, in, 8);
+			return __crc32cd((std::uint32_t)crc, value);
+		}
+		inline std::uint32_t crcByte(std::uint32_t crc, unsigned char in)
+		{
+			return __crc32cb(crc, in);
+		}
+		bool hasHardwareCrc()
+		{
+			return true;
+		}
+#endif
+#if defined(RPK_CRC32C_SSE42) || defined(RPK_CRC32C_ARM)
+	#if defined(RPK_CRC32C_SSE42) && !defined(_MSC_VER)
+		__attribute__((target("sse4.2")))
+	#endif
+		std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* in, std::size_t length)
+		{
+			static const CrcShift shiftLong(CRC_LONG_BLOCK);
+			static const CrcShift shiftShort(CRC_SHORT_BLOCK);
+			std::uint64_t crc0 = crc;
+			const CrcShift* shifts[2] = { &shiftLong, &shiftShort };
+			const std::size_t blocks[2] = { CRC_LONG_BLOCK, CRC_SHORT_BLOCK };
+			for (int size = 0; size < 2; size++) {
+				const CrcShift& shift = *shifts[size];
+				const std::size_t block = blocks[size];
+				for (; length >= block * 3; in += block * 3, length -= block * 3) {
+					std::uint64_t crc1 = 0, crc2 = 0;
+					for (std::size_t i = 0; i < block; i += 8) {
+						crc0 = crcStep(crc0, in + i);
+						crc1 = crcStep(crc1, in + block + i);
+						crc2 = crcStep(crc2, in + block * 2 + i);
+					}
+					crc0 = shift((std::uint32_t)crc0) ^ (std::uint32_t)crc1;
+					crc0 = shift((std::uint32_t)crc0) ^ (std::uint32_t)crc2;
+				}
+			}
+			for (; length >= 8; in += 8, length -= 8) crc0 = crcStep(crc0, in);
+			crc = (std::uint32_t)crc0;
+			for (; length > 0; in++, length--) crc = crcByte(crc, *in);
+			return crc;
+		}
+#endif
+	}
+	std::uint32_t crc32c(std::uint32_t crc, const void* data, std::size_t length)
+	{
+		const unsigned char* in = (const unsigned char*)data;
+		crc = ~crc;
+#if defined(RPK_CRC32C_SSE42) || defined(RPK_CRC32C_ARM)
+		static const bool hardware = hasHardwareCrc();
+		if (hardware) return ~crc32cHardware(crc, in, length);
+#endif
+		return ~crc32cSoftware(crc, in, length);
+	}
+	Xxh64::Xxh64(std::uint64_t seed)
+		: _seed(seed)
+	{
+		_accumulators[0] = seed + PRIME1 + PRIME2;
+		_accumulators[1] = seed + PRIME2;
+		_accumulators[2] = seed;
+		_accumulators[3] = seed - PRIME1;
+	}
+	void Xxh64::update(const void* data, std::size_t length)
+	{
+		const unsigned char* in = (const unsigned char*)data;
+		_totalLength += length;
+		if (_bufferLength + length < 32) {
+			std::memcpy(_buffer + _bufferLength, in, length);
+			_bufferLength += length;
+			return;
+		}
+		if (_bufferLength > 0) {
+			std::size_t fill = 32 - _bufferLength;
+			std::memcpy(_buffer + _bufferLength, in, fill);
+			for (int i = 0; i < 4; i++) _accumulators[i] = round(_accumulators[i], read64(_buffer + i * 8));
+			in += fill;
+			length -= fill;
+			_bufferLength = 0;
+		}
+		std::uint64_t a0 = _accumulators[0], a1 = _accumulators[1], a2 = _accumulators[2], a3 = _accumulators[3];
+		for (; length >= 32; in += 32, length -= 32) {
+			a0 = round(a0, read64(in));
+			a1 = round(a1, read64(in + 8));
+			a2 = round(a2, read64(in + 16));
+			a3 = round(a3, read64(in + 24));
+		}
+		_accumulators[0] = a0;
+		_accumulators[1] = a1;
+		_accumulators[2] = a2;
+		_accumulators[3] = a3;
+		std::memcpy(_buffer, in, length);
+		_bufferLength = length;
+	}
+	std::uint64_t Xxh64::digest() const
+	{
+		std::uint64_t hash;
+		if (_totalLength >= 32) {
+			hash = rotateLeft(_accumulators[0], 1) + rotateLeft(_accumulators[1], 7)
+				+ rotateLeft(_accumulators[2], 12) + rotateLeft(_accumulators[3], 18);
+			for (int i = 0; i < 4; i++) hash = mergeRound(hash, _accumulators[i]);
+		}
+		else {
+			hash = _seed + PRIME5;
+		}
+		hash += _totalLength;
+		std::size_t pos = 0;
+		for (; pos + 8 <= _bufferLength; pos += 8) {
+			hash ^= round(0, read64(_buffer + pos));
+			hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+		}
+		if (pos + 4 <= _bufferLength) {
+			hash ^= (std::uint64_t)read32(_buffer + pos) * PRIME1;
+			hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+			pos += 4;
+		}
+		for (; pos < _bufferLength; pos++) {
+			hash ^= _buffer[pos] * PRIME5;
+			hash = rotateLeft(hash, 11) * PRIME1;
+		}
+		hash ^= hash >> 33;
+		hash *= PRIME2;
+		hash ^= hash >> 29;
+		hash *= PRIME3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+}
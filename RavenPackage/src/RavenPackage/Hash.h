@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace rvn {
+	// CRC32C (Castagnoli), stored per payload in version 2 archives. Continues crc, start with 0.
+	// Uses the SSE4.2 / ARMv8 crc32c instructions when the CPU has them, a table otherwise
+	std::uint32_t crc32c(std::uint32_t crc, const void* data, std::size_t length);
+	// Streaming XXH64, a fast non-cryptographic hash. Used for finding identical files,
+	// it is never stored in archives
+	class Xxh64 {
+	public:
+		explicit Xxh64(std::uint64_t seed = 0);
+		void update(const void* data, std::size_t length);
+		std::uint64_t digest() const;
+	private:
+		std::uint64_t _accumulators[4];
+		std::uint64_t _seed;
+		std::uint64_t _totalLength = 0;
+		unsigned char _buffer[32];
+		std::size_t _bufferLength = 0;
+	};
+}
@@ -0,0 +1,175 @@
+#include "Metrics.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+
+namespace rvn {
+	namespace metrics {
+		namespace detail {
+			std::atomic<bool> enabled = false;
+			std::atomic<bool> tracing = false;
+			std::atomic<std::uint64_t> counters[(std::size_t)Counter::Count] = {};
+		}
+		namespace {
+			struct AtomicHistogram {
+				std::atomic<std::uint64_t> buckets[Histogram::BUCKETS] = {};
+				std::atomic<std::uint64_t> count = 0;
+				std::atomic<std::uint64_t> totalNanoseconds = 0;
+				std::atomic<std::uint64_t> maxNanoseconds = 0;
+			};
+			AtomicHistogram timers[(std::size_t)Timer::Count];
+			// Replaced as a whole, so threads reading the old sink keep it alive
+			std::shared_ptr<const Sink> currentSink = std::make_shared<Sink>();
+			const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+			std::shared_ptr<const Sink> getSink()
+			{
+				return std::atomic_load(&currentSink);
+			}
+			// Small numbers read better in trace viewers than thread ids
+			std::uint64_t getThreadNumber()
+			{
+				static std::atomic<std::uint64_t> next = 1;
+				thread_local std::uint64_t number = next++;
+				return number;
+			}
+		}
+
+		void detail::record(Timer timer, std::chrono::steady_clock::time_point start)
+		{
+			const auto end = std::chrono::steady_clock::now();
+			const std::uint64_t nanoseconds = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			std::size_t bucket = 0;
+			while (bucket + 1 < Histogram::BUCKETS && (nanoseconds >> bucket) != 0) bucket++;
+			AtomicHistogram& histogram = timers[(std::size_t)timer];
+			histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+			histogram.count.fetch_add(1, std::memory_order_relaxed);
+			histogram.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+			std::uint64_t max = histogram.maxNanoseconds.load(std::memory_order_relaxed);
+			while (nanoseconds > max && !histogram.maxNanoseconds.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {}
+
+			if (!tracing.load(std::memory_order_relaxed)) return;
+			std::shared_ptr<const Sink> sink = getSink();
+			if (!sink->trace) return;
+			TraceEvent event;
+			event.name = getName(timer);
+			event.startMicroseconds = (std::uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(start - epoch).count();
+			event.durationMicroseconds = nanoseconds / 1000;
+			event.thread = getThreadNumber();
+			sink->trace(event);
+		}
+		bool detail::isLogging(LogLevel level)
+		{
+			return level == LogLevel::Error || getSink()->log;
+		}
+		void detail::log(LogLevel level, const std::string& message)
+		{
+			std::shared_ptr<const Sink> sink = getSink();
+			if (sink->log) {
+				sink->log(level, message);
+				return;
+			}
+			if (level == LogLevel::Error) std::cerr << "RavenPackage-Error: " << message << '\n';
+		}
+
+		std::uint64_t Histogram::getQuantile(double quantile) const
+		{
+			if (count == 0) return 0;
+			const std::uint64_t target = (std::uint64_t)(quantile * (double)(count - 1)) + 1;
+			std::uint64_t seen = 0;
+			for (std::size_t i = 0; i < BUCKETS; i++) {
+				seen += buckets[i];
+				if (seen >= target) return i == 0 ? 0 : (1ull << i);
+			}
+			return maxNanoseconds;
+		}
+		void setSink(Sink sink)
+		{
+			std::atomic_store(&currentSink, std::shared_ptr<const Sink>(std::make_shared<Sink>(std::move(sink))));
+		}
+		void setEnabled(bool enabled)
+		{
+			detail::enabled = enabled;
+		}
+		void setTracing(bool tracing)
+		{
+			detail::tracing = tracing;
+		}
+		Snapshot getSnapshot()
+		{
+			Snapshot ret;
+			for (std::size_t i = 0; i < (std::size_t)Counter::Count; i++) ret.counters[i] = detail::counters[i].load(std::memory_order_relaxed);
+			for (std::size_t i = 0; i < (std::size_t)Timer::Count; i++) {
+				for (std::size_t bucket = 0; bucket < Histogram::BUCKETS; bucket++) ret.timers[i].buckets[bucket] = timers[i].buckets[bucket].load(std::memory_order_relaxed);
+				ret.timers[i].count = timers[i].count.load(std::memory_order_relaxed);
+				ret.timers[i].totalNanoseconds = timers[i].totalNanoseconds.load(std::memory_order_relaxed);
+				ret.timers[i].maxNanoseconds = timers[i].maxNanoseconds.load(std::memory_order_relaxed);
+			}
+			return ret;
+		}
+		void reset()
+		{
+			for (auto& counter : detail::counters) counter = 0;
+			for (auto& timer : timers) {
+				for (auto& bucket : timer.buckets) bucket = 0;
+				timer.count = 0;
+				timer.totalNanoseconds = 0;
+				timer.maxNanoseconds = 0;
+			}
+		}
+		void report()
+		{
+			std::shared_ptr<const Sink> sink = getSink();
+			if (sink->report) sink->report(getSnapshot());
+		}
+		const char* getName(Counter counter)
+		{
+			switch (counter) {
+			case Counter::BytesRead: return "bytesRead";
+			case Counter::BytesWritten: return "bytesWritten";
+			case Counter::Reads: return "reads";
+			case Counter::Seeks: return "seeks";
+			case Counter::FileOpens: return "fileOpens";
+			case Counter::IndexProbes: return "indexProbes";
+			case Counter::CacheHits: return "cacheHits";
+			case Counter::CacheMisses: return "cacheMisses";
+			default: return "unknown";
+			}
+		}
+		const char* getName(Timer timer)
+		{
+			switch (timer) {
+			case Timer::Lookup: return "lookup";
+			case Timer::Read: return "read";
+			case Timer::Create: return "create";
+			default: return "unknown";
+			}
+		}
+
+		void ChromeTrace::add(const TraceEvent& event)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_events.push_back(event);
+		}
+		std::function<void(const TraceEvent&)> ChromeTrace::getCallback()
+		{
+			return [this](const TraceEvent& event) { add(event); };
+		}
+		bool ChromeTrace::write(const std::string& path) const
+		{
+			std::ofstream out(path, std::ios::binary);
+			if (!out) return false;
+			std::lock_guard<std::mutex> lock(_mutex);
+			out << "{\"traceEvents\":[";
+			for (std::size_t i = 0; i < _events.size(); i++) {
+				const TraceEvent& event = _events[i];
+				out << (i ? ",\n" : "\n") << "{\"name\":\"" << event.name << "\",\"cat\":\"rpk\",\"ph\":\"X\",\"ts\":" << event.startMicroseconds
+					<< ",\"dur\":" << event.durationMicroseconds << ",\"pid\":1,\"tid\":" << event.thread << "}";
+			}
+			out << "\n]}\n";
+			return (bool)out;
+		}
+	}
+}
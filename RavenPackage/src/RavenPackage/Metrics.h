@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counters, latency histograms, trace spans and log messages of the library. Nothing is recorded until
+// metrics::setEnabled(true), a disabled check is one relaxed atomic load. Defining RPK_NO_METRICS
+// compiles all recording out
+namespace rvn {
+	namespace metrics {
+		enum class Counter {
+			BytesRead,
+			BytesWritten,
+			// Positional read calls on archives and input files
+			Reads,
+			// EntryStream::seek calls
+			Seeks,
+			FileOpens,
+			// Hash slots inspected by path lookups
+			IndexProbes,
+			CacheHits,
+			CacheMisses,
+			Count
+		};
+		enum class Timer {
+			// Path lookups in an ArchiveReader
+			Lookup,
+			// Whole-file reads and extractions
+			Read,
+			// Creating, updating and compacting archives
+			Create,
+			Count
+		};
+		enum class LogLevel {
+			Trace,
+			Error
+		};
+		// Bucket i counts durations below 2^i nanoseconds
+		struct Histogram {
+			static const std::size_t BUCKETS = 48;
+			std::uint64_t buckets[BUCKETS] = {};
+			std::uint64_t count = 0;
+			std::uint64_t totalNanoseconds = 0;
+			std::uint64_t maxNanoseconds = 0;
+			// Upper bound of the bucket holding the quantile (0..1)
+			std::uint64_t getQuantile(double quantile) const;
+		};
+		struct Snapshot {
+			std::uint64_t counters[(std::size_t)Counter::Count] = {};
+			Histogram timers[(std::size_t)Timer::Count];
+			std::uint64_t get(Counter counter) const { return counters[(std::size_t)counter]; }
+			const Histogram& get(Timer timer) const { return timers[(std::size_t)timer]; }
+		};
+		// One finished timer, in the units of the Chrome trace event format
+		struct TraceEvent {
+			const char* name = "";
+			std::uint64_t startMicroseconds = 0;
+			std::uint64_t durationMicroseconds = 0;
+			std::uint64_t thread = 0;
+		};
+		// Callbacks are invoked on the thread that produced the data, unset ones are skipped
+		struct Sink {
+			std::function<void(LogLevel, const std::string&)> log;
+			std::function<void(const TraceEvent&)> trace;
+			std::function<void(const Snapshot&)> report;
+		};
+
+		// Replaces the sink. Without one, errors go to std::cerr and everything else is dropped
+		void setSink(Sink sink);
+		void setEnabled(bool enabled);
+		// Whether timers are passed to Sink::trace, needs metrics to be enabled
+		void setTracing(bool tracing);
+		Snapshot getSnapshot();
+		void reset();
+		// Hands the current snapshot to Sink::report
+		void report();
+		const char* getName(Counter counter);
+		const char* getName(Timer timer);
+
+		// Collects trace events and writes them as a Chrome trace (chrome://tracing, Perfetto)
+		class ChromeTrace {
+		public:
+			void add(const TraceEvent& event);
+			// Sink::trace that adds to this trace
+			std::function<void(const TraceEvent&)> getCallback();
+			bool write(const std::string& path) const;
+		private:
+			mutable std::mutex _mutex;
+			std::vector<TraceEvent> _events;
+		};
+
+		namespace detail {
+			extern std::atomic<bool> enabled;
+			extern std::atomic<bool> tracing;
+			extern std::atomic<std::uint64_t> counters[(std::size_t)Counter::Count];
+			void record(Timer timer, std::chrono::steady_clock::time_point start);
+			bool isLogging(LogLevel level);
+			void log(LogLevel level, const std::string& message);
+		}
+
+#ifndef RPK_NO_METRICS
+		inline bool isEnabled()
+		{
+			return detail::enabled.load(std::memory_order_relaxed);
+		}
+		inline void add(Counter counter, std::uint64_t value = 1)
+		{
+			if (isEnabled()) detail::counters[(std::size_t)counter].fetch_add(value, std::memory_order_relaxed);
+		}
+		// Measures its own lifetime, the clock is only read while metrics are enabled
+		class ScopedTimer {
+		public:
+			explicit ScopedTimer(Timer timer)
+				: _timer(timer), _active(isEnabled())
+			{
+				if (_active) _start = std::chrono::steady_clock::now();
+			}
+			~ScopedTimer()
+			{
+				if (_active) detail::record(_timer, _start);
+			}
+			ScopedTimer(const ScopedTimer&) = delete;
+			ScopedTimer& operator=(const ScopedTimer&) = delete;
+		private:
+			Timer _timer;
+			bool _active;
+			std::chrono::steady_clock::time_point _start;
+		};
+#else
+		inline bool isEnabled() { return false; }
+		inline void add(Counter, std::uint64_t = 1) {}
+		class ScopedTimer {
+		public:
+			explicit ScopedTimer(Timer) {}
+		};
+#endif
+	}
+}
@@ -0,0 +1,119 @@
+#include "PathQuery.h"
+#include "ArchiveReader.h"
+
+namespace rvn {
+	bool matchGlob(std::string_view pattern, std::string_view path)
+	{
+		// Backtracking points: the last '*' and the last "**". A wildcard that matched as little as possible leaves the
+		// most to the ones after it, so only the last of each kind is retried, which keeps the match O(pattern * path)
+		std::size_t p = 0, s = 0;
+		std::size_t starP = std::string_view::npos, starS = 0;
+		std::size_t deepP = std::string_view::npos, deepS = 0;
+		bool deepDirectory = false;
+		while (s < path.length()) {
+			if (p < pattern.length() && pattern[p] == '*') {
+				if (p + 1 < pattern.length() && pattern[p + 1] == '*') {
+					p += 2;
+					// "**/" matches whole directories, none at all too: the rest starts at s or right after any later '/'
+					deepDirectory = p < pattern.length() && pattern[p] == '/';
+					deepP = p;
+					deepS = s;
+					starP = std::string_view::npos;
+					if (deepDirectory) {
+						deepP++;
+						// Only whole directories, in the middle of a name the rest starts after the next '/'
+						if (s > 0 && path[s - 1] != '/') {
+							const std::size_t separator = path.find('/', s);
+							if (separator == std::string_view::npos) return false;
+							deepS = separator + 1;
+						}
+					}
+					p = deepP;
+					s = deepS;
+				}
+				else {
+					starP = ++p;
+					starS = s;
+				}
+				continue;
+			}
+			if (p < pattern.length() && (pattern[p] == '?' ? path[s] != '/' : pattern[p] == path[s])) {
+				p++;
+				s++;
+				continue;
+			}
+			if (starP != std::string_view::npos && path[starS] != '/') {
+				p = starP;
+				s = ++starS;
+				continue;
+			}
+			if (deepP != std::string_view::npos) {
+				if (deepDirectory) {
+					const std::size_t separator = path.find('/', deepS);
+					if (separator == std::string_view::npos) return false;
+					deepS = separator + 1;
+				}
+				else if (++deepS > path.length()) {
+					return false;
+				}
+				p = deepP;
+				s = deepS;
+				starP = std::string_view::npos;
+				continue;
+			}
+			return false;
+		}
+		// The path is used up, only wildcards that can match nothing may be left
+		while (p < pattern.length()) {
+			if (pattern[p] != '*') return false;
+			p++;
+			if (p < pattern.length() && pattern[p] == '*') {
+				p++;
+				if (p < pattern.length() && pattern[p] == '/') {
+					if (!path.empty() && path.back() != '/') return false;
+					p++;
+				}
+			}
+		}
+		return true;
+	}
+
+	PathQuery::Iterator::Iterator(const PathQuery* query, std::size_t position)
+		: _query(query), _position(position)
+	{
+		if (_query) advance();
+	}
+	PathQuery::Iterator& PathQuery::Iterator::operator++()
+	{
+		_position++;
+		advance();
+		return *this;
+	}
+	void PathQuery::Iterator::advance()
+	{
+		if (!_query->_order) {
+			_position = SIZE_MAX;
+			return;
+		}
+		const ArchiveReader& reader = *_query->_reader;
+		const std::vector<std::uint32_t>& order = *_query->_order;
+		for (; _position < order.size(); _position++) {
+			const ArchiveReader::IndexEntry& entry = reader._entries[order[_position]];
+			const std::string_view path(reader._paths.data() + entry.pathOffset, entry.pathLength);
+			// Sorted, so the first path without the prefix ends the range
+			if (path.compare(0, _query->_prefix.length(), _query->_prefix) != 0) break;
+			if (_query->_glob && !matchGlob(_query->_pattern, path)) continue;
+			_match.path = path;
+			_match.isFile = entry.isFile();
+			_match.length = entry.length;
+			return;
+		}
+		_position = SIZE_MAX;
+	}
+	std::vector<std::string> PathQuery::getPaths() const
+	{
+		std::vector<std::string> ret;
+		for (auto& match : *this) ret.emplace_back(match.path);
+		return ret;
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "RavenPackage.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rvn {
+	// A file or directory found by a query. The path points into the reader and is valid while it is open
+	struct PathMatch {
+		std::string_view path;
+		bool isFile = true;
+		// Decoded length, for directories the total of all files below
+		std::uint64_t length = 0;
+	};
+	// Whether a normalized path matches a glob pattern. '*' matches any characters except '/', '?' one
+	// character except '/' and "**" any characters including '/'. "**/" matches zero or more whole directories,
+	// so "a/**/*.png" finds "a/b.png" as well as "a/b/c/d.png". Linear in the length of the path per
+	// wildcard, patterns with many wildcards can't make it backtrack exponentially
+	bool matchGlob(std::string_view pattern, std::string_view path);
+
+	// Lazily evaluated result of ArchiveReader::query and ArchiveReader::queryPrefix, matches come in path order.
+	// The paths starting with the literal part of the pattern are one range of the sorted path index, iterating
+	// only walks that range, so the cost follows the size of the range and not the size of the archive.
+	// The reader has to stay open while the query is used
+	class PathQuery {
+	public:
+		class Iterator {
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = PathMatch;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const PathMatch*;
+			using reference = const PathMatch&;
+
+			const PathMatch& operator*() const { return _match; }
+			const PathMatch* operator->() const { return &_match; }
+			Iterator& operator++();
+			bool operator==(const Iterator& other) const { return _position == other._position; }
+			bool operator!=(const Iterator& other) const { return _position != other._position; }
+		private:
+			friend class PathQuery;
+			Iterator(const PathQuery* query, std::size_t position);
+			// Moves to the first match at or after _position, SIZE_MAX once the range is done
+			void advance();
+
+			const PathQuery* _query;
+			std::size_t _position;
+			PathMatch _match;
+		};
+
+		PathQuery() = default;
+		Iterator begin() const { return Iterator(this, _first); }
+		Iterator end() const { return Iterator(nullptr, SIZE_MAX); }
+		// Runs the query to the end and copies the matching paths
+		std::vector<std::string> getPaths() const;
+	private:
+		friend class ArchiveReader;
+
+		const ArchiveReader* _reader = nullptr;
+		// Entry indices sorted by path, shared with the reader
+		std::shared_ptr<const std::vector<std::uint32_t>> _order;
+		// Start of the range, the first path in _order that doesn't sort before _prefix
+		std::size_t _first = SIZE_MAX;
+		std::string _prefix;
+		// Glob matched against the whole path, prefix queries have none
+		std::string _pattern;
+		bool _glob = false;
+	};
+}
@@ -0,0 +1,494 @@
+#include "Platform.h"
+#include "Metrics.h"
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#include <dirent.h>
+	#include <cerrno>
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <random>
+#include <utility>
+
+namespace rvn {
+	namespace platform {
+		File::~File()
+		{
+			close();
+		}
+		File::File(File&& other) noexcept
+		{
+			*this = std::move(other);
+		}
+		File& File::operator=(File&& other) noexcept
+		{
+			if (this != &other) {
+				close();
+#ifdef _WIN32
+				_handle = other._handle;
+				other._handle = nullptr;
+#else
+				_fd = other._fd;
+				other._fd = -1;
+#endif
+				_size = other._size;
+				other._size = 0;
+			}
+			return *this;
+		}
+#ifdef _WIN32
+		bool File::openRead(const std::string& path, bool unbuffered)
+		{
+			close();
+			DWORD flags = unbuffered ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL;
+			HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) return false;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(handle, &size)) {
+				CloseHandle(handle);
+				return false;
+			}
+			_handle = handle;
+			_size = (std::uint64_t)size.QuadPart;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openWrite(const std::string& path)
+		{
+			close();
+			HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) return false;
+			_handle = handle;
+			_size = 0;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openNew(const std::string& path)
+		{
+			close();
+			HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) return false;
+			_handle = handle;
+			_size = 0;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openReadWrite(const std::string& path)
+		{
+			close();
+			HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (handle == INVALID_HANDLE_VALUE) return false;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(handle, &size)) {
+				CloseHandle(handle);
+				return false;
+			}
+			_handle = handle;
+			_size = (std::uint64_t)size.QuadPart;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		void File::close()
+		{
+			if (_handle) {
+				CloseHandle((HANDLE)_handle);
+				_handle = nullptr;
+			}
+			_size = 0;
+		}
+		bool File::isOpen() const
+		{
+			return _handle != nullptr;
+		}
+		std::size_t File::readAt(std::uint64_t offset, void* dst, std::size_t length) const
+		{
+			std::size_t done = 0;
+			while (done < length) {
+				OVERLAPPED overlapped = {};
+				std::uint64_t position = offset + done;
+				overlapped.Offset = (DWORD)(position & 0xFFFFFFFF);
+				overlapped.OffsetHigh = (DWORD)(position >> 32);
+				DWORD chunk = (DWORD)((length - done) > 0x40000000 ? 0x40000000 : (length - done));
+				DWORD read = 0;
+				if (!ReadFile((HANDLE)_handle, (char*)dst + done, chunk, &read, &overlapped) || read == 0) break;
+				done += read;
+			}
+			metrics::add(metrics::Counter::Reads);
+			metrics::add(metrics::Counter::BytesRead, done);
+			return done;
+		}
+		bool File::writeAt(std::uint64_t offset, const void* src, std::size_t length) const
+		{
+			metrics::add(metrics::Counter::BytesWritten, length);
+			std::size_t done = 0;
+			while (done < length) {
+				OVERLAPPED overlapped = {};
+				std::uint64_t position = offset + done;
+				overlapped.Offset = (DWORD)(position & 0xFFFFFFFF);
+				overlapped.OffsetHigh = (DWORD)(position >> 32);
+				DWORD chunk = (DWORD)((length - done) > 0x40000000 ? 0x40000000 : (length - done));
+				DWORD written = 0;
+				if (!WriteFile((HANDLE)_handle, (const char*)src + done, chunk, &written, &overlapped) || written == 0) return false;
+				done += written;
+			}
+			return true;
+		}
+		bool File::truncate(std::uint64_t size)
+		{
+			FILE_END_OF_FILE_INFO info = {};
+			info.EndOfFile.QuadPart = (LONGLONG)size;
+			if (!SetFileInformationByHandle((HANDLE)_handle, FileEndOfFileInfo, &info, sizeof(info))) return false;
+			_size = size;
+			return true;
+		}
+#else
+		bool File::openRead(const std::string& path, bool unbuffered)
+		{
+			close();
+			int flags = O_RDONLY | O_CLOEXEC;
+#ifdef O_DIRECT
+			if (unbuffered) flags |= O_DIRECT;
+#endif
+			int fd = ::open(path.c_str(), flags);
+			if (fd < 0) return false;
+#if defined(__APPLE__)
+			if (unbuffered && fcntl(fd, F_NOCACHE, 1) != 0) {
+				::close(fd);
+				return false;
+			}
+#endif
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				::close(fd);
+				return false;
+			}
+			_fd = fd;
+			_size = (std::uint64_t)st.st_size;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openWrite(const std::string& path)
+		{
+			close();
+			int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd < 0) return false;
+			_fd = fd;
+			_size = 0;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openNew(const std::string& path)
+		{
+			close();
+			int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+			if (fd < 0) return false;
+			_fd = fd;
+			_size = 0;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		bool File::openReadWrite(const std::string& path)
+		{
+			close();
+			int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+			if (fd < 0) return false;
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				::close(fd);
+				return false;
+			}
+			_fd = fd;
+			_size = (std::uint64_t)st.st_size;
+			metrics::add(metrics::Counter::FileOpens);
+			return true;
+		}
+		void File::close()
+		{
+			if (_fd >= 0) {
+				::close(_fd);
+				_fd = -1;
+			}
+			_size = 0;
+		}
+		bool File::isOpen() const
+		{
+			return _fd >= 0;
+		}
+		std::size_t File::readAt(std::uint64_t offset, void* dst, std::size_t length) const
+		{
+			std::size_t done = 0;
+			while (done < length) {
+				ssize_t read = ::pread(_fd, (char*)dst + done, length - done, (off_t)(offset + done));
+				if (read < 0 && errno == EINTR) continue;
+				if (read <= 0) break;
+				done += (std::size_t)read;
+			}
+			metrics::add(metrics::Counter::Reads);
+			metrics::add(metrics::Counter::BytesRead, done);
+			return done;
+		}
+		bool File::writeAt(std::uint64_t offset, const void* src, std::size_t length) const
+		{
+			metrics::add(metrics::Counter::BytesWritten, length);
+			std::size_t done = 0;
+			while (done < length) {
+				ssize_t written = ::pwrite(_fd, (const char*)src + done, length - done, (off_t)(offset + done));
+				if (written < 0 && errno == EINTR) continue;
+				if (written <= 0) return false;
+				done += (std::size_t)written;
+			}
+			return true;
+		}
+		bool File::truncate(std::uint64_t size)
+		{
+			if (::ftruncate(_fd, (off_t)size) != 0) return false;
+			_size = size;
+			return true;
+		}
+#endif
+		bool File::openTemp(const std::string& path, std::string& tempPath)
+		{
+			static std::atomic<std::uint64_t> counter{ std::random_device()() };
+			static const char digits[] = "0123456789abcdef";
+			// A name that is taken, by anyone, is skipped. Only a missing directory or similar fails every attempt
+			for (int attempt = 0; attempt < 16; attempt++) {
+				std::uint64_t value = counter.fetch_add(0x9e3779b97f4a7c15ull) * 0xbf58476d1ce4e5b9ull;
+				std::string suffix;
+				for (int i = 0; i < 12; i++, value >>= 4) suffix.push_back(digits[value & 15]);
+				tempPath = path + "." + suffix + ".tmp";
+				if (openNew(tempPath)) return true;
+			}
+			tempPath.clear();
+			return false;
+		}
+		bool File::copyTo(std::uint64_t offset, const File& dst, std::uint64_t dstOffset, std::uint64_t length, Buffer& buffer) const
+		{
+			std::uint64_t done = 0;
+#ifdef __linux__
+			while (done < length) {
+				loff_t in = (loff_t)(offset + done);
+				loff_t out = (loff_t)(dstOffset + done);
+				ssize_t copied = ::copy_file_range(_fd, &in, dst._fd, &out, (std::size_t)std::min<std::uint64_t>(length - done, 0x40000000), 0);
+				if (copied < 0 && errno == EINTR) continue;
+				// Unsupported (old kernel, different file systems) or short, the loop below takes over
+				if (copied <= 0) break;
+				done += (std::uint64_t)copied;
+				metrics::add(metrics::Counter::BytesRead, (std::uint64_t)copied);
+				metrics::add(metrics::Counter::BytesWritten, (std::uint64_t)copied);
+			}
+#endif
+			while (done < length) {
+				std::size_t chunk = (std::size_t)std::min<std::uint64_t>(buffer.getLength(), length - done);
+				if (readAt(offset + done, buffer.getData(), chunk) != chunk) return false;
+				if (!dst.writeAt(dstOffset + done, buffer.getData(), chunk)) return false;
+				done += chunk;
+			}
+			return true;
+		}
+		Buffer::Buffer(std::size_t length)
+			: _length(length)
+		{
+			_data = (char*)::operator new(length, std::align_val_t(RPK_COPY_BUFFER_ALIGNMENT));
+		}
+		Buffer::~Buffer()
+		{
+			::operator delete(_data, std::align_val_t(RPK_COPY_BUFFER_ALIGNMENT));
+		}
+		MappedFile::~MappedFile()
+		{
+			unmap();
+		}
+#ifdef _WIN32
+		bool MappedFile::map(const File& file)
+		{
+			unmap();
+			if (!file.isOpen()) return false;
+			_size = file.getSize();
+			if (_size == 0) return true;
+			HANDLE mapping = CreateFileMappingA((HANDLE)file._handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) return false;
+			// The view keeps its own reference to the mapping object
+			void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);
+			if (!data) return false;
+			_data = (const char*)data;
+			return true;
+		}
+		void MappedFile::unmap()
+		{
+			if (_data) UnmapViewOfFile(_data);
+			_data = nullptr;
+			_size = 0;
+		}
+#else
+		bool MappedFile::map(const File& file)
+		{
+			unmap();
+			if (!file.isOpen()) return false;
+			_size = file.getSize();
+			if (_size == 0) return true;
+			void* data = mmap(nullptr, (std::size_t)_size, PROT_READ, MAP_SHARED, file._fd, 0);
+			if (data == MAP_FAILED) {
+				_size = 0;
+				return false;
+			}
+			_data = (const char*)data;
+			return true;
+		}
+		void MappedFile::unmap()
+		{
+			if (_data) munmap((void*)_data, (std::size_t)_size);
+			_data = nullptr;
+			_size = 0;
+		}
+#endif
+#ifdef _WIN32
+		bool renameNoReplace(const std::string& from, const std::string& to)
+		{
+			return MoveFileExA(from.c_str(), to.c_str(), 0) != 0;
+		}
+#else
+		bool renameNoReplace(const std::string& from, const std::string& to)
+		{
+#if defined(__linux__) && defined(SYS_renameat2)
+			if (syscall(SYS_renameat2, AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), 1u /* RENAME_NOREPLACE */) == 0) return true;
+			// Older kernels and some file systems don't know the flag, everything else is a real failure
+			if (errno != ENOSYS && errno != EINVAL) return false;
+#endif
+			// link fails if to exists, the old name is dropped afterwards
+			if (::link(from.c_str(), to.c_str()) != 0) return false;
+			::unlink(from.c_str());
+			return true;
+		}
+#endif
+#ifdef _WIN32
+		bool listDirectory(const std::string& path, std::vector<DirectoryItem>& items)
+		{
+			WIN32_FIND_DATAA data;
+			// Basic info skips the short names, large fetch asks for bigger batches per call
+			HANDLE find = FindFirstFileExA((path + "\\*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+			if (find == INVALID_HANDLE_VALUE) return false;
+			do {
+				if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) continue;
+				if (data.dwFileAttributes & FILE_ATTRIBUTE_DEVICE) continue;
+				DirectoryItem item;
+				item.name = data.cFileName;
+				item.isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+				item.isLink = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+				item.size = ((std::uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+				if (item.isLink && !item.isDirectory) {
+					// The listing has the size of the link, opening it follows the link
+					File target;
+					if (!target.openRead(path + "\\" + item.name)) continue;
+					item.size = target.getSize();
+				}
+				items.push_back(std::move(item));
+			} while (FindNextFileA(find, &data));
+			const bool ended = GetLastError() == ERROR_NO_MORE_FILES;
+			FindClose(find);
+			return ended;
+		}
+#else
+		// Completes an entry whose type the listing didn't tell or that is a link, false leaves it out
+		static bool statAt(int dirFd, const char* name, bool follow, DirectoryItem& item)
+		{
+			const int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+			mode_t mode;
+#ifdef STATX_SIZE
+			// Only type and size are asked for, network file systems don't have to sync for them
+			struct statx st;
+			if (statx(dirFd, name, flags | AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE, &st) != 0) return false;
+			mode = st.stx_mode;
+			item.size = st.stx_size;
+#else
+			struct stat st;
+			if (fstatat(dirFd, name, &st, flags) != 0) return false;
+			mode = st.st_mode;
+			item.size = (std::uint64_t)st.st_size;
+#endif
+			if (S_ISLNK(mode)) {
+				item.isLink = true;
+				return statAt(dirFd, name, true, item);
+			}
+			item.isDirectory = S_ISDIR(mode);
+			if (item.isDirectory) item.size = 0;
+			return item.isDirectory || S_ISREG(mode);
+		}
+		// Adds one entry of a listing, d_type saves the stat for directories
+		static void addItem(int dirFd, const char* name, unsigned char type, std::vector<DirectoryItem>& items)
+		{
+			if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) return;
+			DirectoryItem item;
+			if (type == DT_DIR) {
+				item.isDirectory = true;
+			}
+			else if (type == DT_REG) {
+				if (!statAt(dirFd, name, true, item)) return;
+			}
+			else if (type == DT_LNK || type == DT_UNKNOWN) {
+				if (!statAt(dirFd, name, false, item)) return;
+			}
+			else {
+				return;
+			}
+			item.name = name;
+			items.push_back(std::move(item));
+		}
+		bool listDirectory(const std::string& path, std::vector<DirectoryItem>& items)
+		{
+			int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (fd < 0) return false;
+#ifdef __linux__
+			// Raw getdents64 fills the whole buffer per call, readdir hands out one entry at a time
+			alignas(struct dirent64) char buffer[32768];
+			for (;;) {
+				long read = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+				if (read < 0 && errno == EINTR) continue;
+				if (read <= 0) {
+					::close(fd);
+					return read == 0;
+				}
+				for (long offset = 0; offset < read;) {
+					const struct dirent64* entry = (const struct dirent64*)(buffer + offset);
+					addItem(fd, entry->d_name, entry->d_type, items);
+					offset += entry->d_reclen;
+				}
+			}
+#else
+			DIR* dir = fdopendir(fd);
+			if (!dir) {
+				::close(fd);
+				return false;
+			}
+			for (;;) {
+				errno = 0;
+				const struct dirent* entry = readdir(dir);
+				if (!entry) break;
+				addItem(fd, entry->d_name, entry->d_type, items);
+			}
+			const bool ended = errno == 0;
+			closedir(dir);
+			return ended;
+#endif
+		}
+#endif
+	}
+}
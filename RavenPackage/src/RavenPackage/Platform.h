@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Buffers for copying payloads, aligned so they also work for unbuffered I/O
+#define RPK_COPY_BUFFER_SIZE 1048576
+#define RPK_COPY_BUFFER_ALIGNMENT 4096
+
+namespace rvn {
+	namespace platform {
+		// Aligned heap buffer, meant to be allocated once and reused for every copy
+		class Buffer {
+		public:
+			explicit Buffer(std::size_t length = RPK_COPY_BUFFER_SIZE);
+			~Buffer();
+			Buffer(const Buffer&) = delete;
+			Buffer& operator=(const Buffer&) = delete;
+
+			char* getData() const { return _data; }
+			std::size_t getLength() const { return _length; }
+		private:
+			char* _data = nullptr;
+			std::size_t _length = 0;
+		};
+		// Thin wrapper around a native file handle. Reads and writes are positional (pread/pwrite,
+		// overlapped ReadFile/WriteFile), so one handle can be shared by several threads without locking
+		class File {
+		public:
+			File() = default;
+			~File();
+			File(const File&) = delete;
+			File& operator=(const File&) = delete;
+			File(File&& other) noexcept;
+			File& operator=(File&& other) noexcept;
+
+			// Opens an existing file for reading. Unbuffered handles bypass the OS cache (O_DIRECT,
+			// FILE_FLAG_NO_BUFFERING), their offsets, lengths and buffers have to be aligned to
+			// RPK_COPY_BUFFER_ALIGNMENT. Fails if the file system doesn't support it
+			bool openRead(const std::string& path, bool unbuffered = false);
+			// Creates a file or truncates an existing one for writing
+			bool openWrite(const std::string& path);
+			// Creates a new file for writing, fails if anything exists at path (O_EXCL, CREATE_NEW)
+			bool openNew(const std::string& path);
+			// Creates a new file with a unique name next to path ("<path>.<random>.tmp") and stores its name in
+			// tempPath. Never opens or truncates an existing file, for writing something that is renamed later
+			bool openTemp(const std::string& path, std::string& tempPath);
+			// Opens an existing file for reading and writing, keeps its contents
+			bool openReadWrite(const std::string& path);
+			void close();
+			bool isOpen() const;
+			// Size of the file when it was opened
+			std::uint64_t getSize() const { return _size; }
+			// Reads up to length bytes at offset, returns the number of bytes read
+			std::size_t readAt(std::uint64_t offset, void* dst, std::size_t length) const;
+			// Writes all length bytes at offset
+			bool writeAt(std::uint64_t offset, const void* src, std::size_t length) const;
+			// Cuts the file off at size
+			bool truncate(std::uint64_t size);
+#ifndef _WIN32
+			// For APIs that need the raw descriptor, like io_uring
+			int getDescriptor() const { return _fd; }
+#endif
+			// Copies length bytes at offset to dstOffset in dst. Linux copies inside the kernel
+			// (copy_file_range), otherwise and if that isn't supported the data goes through buffer
+			bool copyTo(std::uint64_t offset, const File& dst, std::uint64_t dstOffset, std::uint64_t length, Buffer& buffer) const;
+		private:
+#ifdef _WIN32
+			void* _handle = nullptr;
+#else
+			int _fd = -1;
+#endif
+			std::uint64_t _size = 0;
+			friend class MappedFile;
+		};
+		// Renames from to to, fails instead of replacing anything at to (renameat2 with RENAME_NOREPLACE or
+		// link and unlink, MoveFileEx without MOVEFILE_REPLACE_EXISTING)
+		bool renameNoReplace(const std::string& from, const std::string& to);
+		// A regular file or directory in a directory listing
+		struct DirectoryItem {
+			std::string name;
+			bool isDirectory = false;
+			// Symbolic links (reparse points on Windows) count as what they point to, linked directories aren't entered
+			bool isLink = false;
+			// Files only
+			std::uint64_t size = 0;
+		};
+		// Appends the regular files and directories in path to items, without "." and "..", in no particular order.
+		// The directory is enumerated once (getdents64, FindFirstFileEx) and files are stat'ed relative to it,
+		// Windows gets the sizes from the enumeration. Entries that vanish while listing are left out
+		bool listDirectory(const std::string& path, std::vector<DirectoryItem>& items);
+		// Read-only mapping of a whole file. Pages are only loaded when they are touched,
+		// the mapping stays valid after the file it was created from is closed
+		class MappedFile {
+		public:
+			MappedFile() = default;
+			~MappedFile();
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			bool map(const File& file);
+			void unmap();
+			const char* getData() const { return _data; }
+			std::uint64_t getSize() const { return _size; }
+		private:
+			const char* _data = nullptr;
+			std::uint64_t _size = 0;
+		};
+	}
+}
@@ -1,37 +1,84 @@
 #include "RavenPackage.h"
+#include "ArchiveReader.h"
+#include "DirectoryScanner.h"
+#include "Format.h"
+#include "Hash.h"
+#include "Platform.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <type_traits>
+#include <unordered_set>
+
+// Content id of files without an identical copy
+#define RPK_NO_CONTENT_ID SIZE_MAX
 
 namespace rvn {
+	// Decoded chunks are read into copy buffers
+	static_assert(RPK_COPY_BUFFER_SIZE >= RPK_COMPRESSION_CHUNK_SIZE, "Copy buffers have to hold a whole chunk");
+
+	// Orders payload indices by their position in CreateOptions::accessOrder, the first occurrence of a path counts.
+	// Unlisted paths keep their order behind the listed ones
+	template<typename GetPath>
+	static void sortByAccess(std::vector<std::size_t>& order, const CreateOptions& options, GetPath getPath)
+	{
+		if (options.accessOrder.empty()) return;
+		std::unordered_map<std::string, std::size_t> ranks;
+		ranks.reserve(options.accessOrder.size());
+		for (auto& path : options.accessOrder) ranks.emplace(format::normalizePath(path), ranks.size());
+		std::vector<std::pair<std::size_t, std::size_t>> keys;
+		keys.reserve(order.size());
+		for (std::size_t index : order) {
+			auto it = ranks.find(getPath(index));
+			keys.push_back({ it == ranks.end() ? SIZE_MAX : it->second, index });
+		}
+		std::stable_sort(keys.begin(), keys.end(), [](const std::pair<std::size_t, std::size_t>& a, const std::pair<std::size_t, std::size_t>& b) {
+			return a.first < b.first;
+		});
+		for (std::size_t i = 0; i < keys.size(); i++) order[i] = keys[i].second;
+	}
+
 	/* Structure definition */
 	using fpath = std::filesystem::path;
 	struct package::Structure {
 		struct FileEntry {
-			FileEntry(const File& file, const std::string& name) : file(file) 
+			FileEntry(File file, const std::string& name, const Compression& compression = Compression())
+				: file(std::move(file)), compression(compression)
 			{
 				this->name = name;
-			}
-			int writeToOutput(std::ofstream& out) {
-				file.open();
-				auto& in = file.getIStream();
-				if (in) {
-					std::string buf(BUF_SIZE, 0x00);
-					for (std::uint64_t i = 0; i < (file.getLength() / BUF_SIZE) + 1; i++) {
-						buf = std::string(file.getLength() - in->tellg() > BUF_SIZE ? BUF_SIZE : file.getLength() - in->tellg(), 0x00);
-						in->read(&buf[0], buf.length());
-						out << buf;
-					}
-				}
-				else {
-					RPK_ERROR("Couldn't open file '" + file.getName() + "'");
-					return RPK_COULDNT_OPEN_FILE;
-				}
-				return RPK_OK;
+				// The only stat of the source, everything after uses this length
+				length = this->file.getLength();
 			}
 			File file;
 			std::string name;
+			Compression compression;
+			std::uint64_t length;
+			// Files with identical contents share an id, RPK_NO_CONTENT_ID if there is no other copy
+			std::size_t contentId = RPK_NO_CONTENT_ID;
+			// Whether the payload is written for this copy, the others point at it
+			bool ownsPayload = true;
+			// Files packed into this solid block, back to back
+			std::vector<const FileEntry*> members;
+		};
+		// A file payload, version 1 archives know the offsets of every payload before writing
+		struct PayloadJob {
+			FileEntry* file = nullptr;
+			std::uint64_t begin = 0;
+			std::uint64_t end = 0;
+			std::uint8_t codec = RPK_CODEC_NONE;
+			// CRC32C of the stored bytes, if the writer computes checksums
+			std::uint32_t checksum = 0;
 		};
 		struct DirectoryEntry {
 			DirectoryEntry(const std::string& name) {
@@ -46,7 +93,7 @@ namespace rvn {
 					dir.calculateLength();
 				}
 				for (auto& file : files) {
-					length += file.file.getLength();
+					if (file.ownsPayload) length += file.length;
 					headerlength += RPK_V1_FILE_HEADER_LENGTH;
 					headerlength += file.name.length();
 				}
@@ -56,75 +103,512 @@ namespace rvn {
 					headerlength += dir.name.length();
 				}
 			}
-			int writeToOutput(std::ofstream& out) {
-				if ((directories.size() + files.size()) > UINT16_MAX) return RPK_TOO_MANY_FILES;
-				else {
-					std::uint64_t dirStart = out.tellp();
-					std::uint64_t currentBegin = dirStart + headerlength;
-					out.write(util::convertUint16ToChars((std::uint16_t)files.size() + (std::uint16_t)directories.size()).chars, 2);
-					for (auto& file : files) {
-						out << (char)RPK_TRAIT_IS_FILE;
-						out << (std::uint8_t)file.file.getName().length();
-						out << file.file.getName().substr(0, 255);
-						out.write(util::convertUint64ToChars(currentBegin).chars, 8);
-						currentBegin += file.file.getLength();
-						out.write(util::convertUint64ToChars(currentBegin).chars, 8);
-					}
-					for (auto& dir : directories) {
-						out << (char)0;
-						out << (uint8_t)dir.name.length();
-						out << dir.name.substr(0, 255);
-						out.write(util::convertUint64ToChars(currentBegin).chars, 8);
-						currentBegin += dir.length + dir.headerlength;
+			// Writes the version 1 header table of this directory at dirStart and queues the payloads below it
+			// payloads collects the range of every content id, so duplicates can point at it
+			int writeHeaders(const platform::File& out, std::uint64_t dirStart, std::vector<PayloadJob>& jobs,
+				std::unordered_map<std::size_t, std::pair<std::uint64_t, std::uint64_t>>& payloads) {
+				if ((directories.size() + files.size()) > UINT16_MAX) {
+					RPK_ERROR("Directory '" + name + "' contains too many files and directories for version 1 (over 65535)");
+					return RPK_TOO_MANY_FILES;
+				}
+				std::string table;
+				std::uint64_t currentBegin = dirStart + headerlength;
+				table.append(util::convertUint16ToChars((std::uint16_t)(files.size() + directories.size())).chars, 2);
+				for (auto& file : files) {
+					if (file.name.length() > 255) {
+						RPK_ERROR("File name '" + file.name + "' is too long for version 1");
+						return RPK_INVALID_PATH;
 					}
-					for (auto& file : files) {
-						file.writeToOutput(out);
+					table.push_back((char)RPK_TRAIT_IS_FILE);
+					table.push_back((char)file.name.length());
+					table += file.name;
+					if (!file.ownsPayload) {
+						// The copy owning the payload always comes first in header order
+						auto& range = payloads.at(file.contentId);
+						table.append(util::convertUint64ToChars(range.first).chars, 8);
+						table.append(util::convertUint64ToChars(range.second).chars, 8);
+						continue;
 					}
-					for (auto& dir : directories) {
-						dir.writeToOutput(out);
+					table.append(util::convertUint64ToChars(currentBegin).chars, 8);
+					PayloadJob job;
+					job.file = &file;
+					job.begin = currentBegin;
+					currentBegin += file.length;
+					job.end = currentBegin;
+					jobs.push_back(job);
+					if (file.contentId != RPK_NO_CONTENT_ID) payloads[file.contentId] = { job.begin, job.end };
+					table.append(util::convertUint64ToChars(currentBegin).chars, 8);
+				}
+				std::vector<std::uint64_t> dirBegins;
+				for (auto& dir : directories) {
+					if (dir.name.length() > 255) {
+						RPK_ERROR("Directory name '" + dir.name + "' is too long for version 1");
+						return RPK_INVALID_PATH;
 					}
+					table.push_back((char)0);
+					table.push_back((char)dir.name.length());
+					table += dir.name;
+					table.append(util::convertUint64ToChars(currentBegin).chars, 8);
+					dirBegins.push_back(currentBegin);
+					currentBegin += dir.length + dir.headerlength;
+				}
+				if (!out.writeAt(dirStart, table.data(), table.length())) {
+					RPK_ERROR("Couldn't write output file");
+					return RPK_COULDNT_OPEN_FILE;
+				}
+				for (std::size_t i = 0; i < directories.size(); i++) {
+					int status = directories[i].writeHeaders(out, dirBegins[i], jobs, payloads);
+					if (status != RPK_OK) return status;
 				}
 				return RPK_OK;
 			}
 			std::uint64_t getLength() const { return length; }
 			std::uint64_t getHeaderLength() const { return headerlength; }
+			// Subdirectory with that name, created if it doesn't exist yet
+			DirectoryEntry& getDirectory(const std::string& name) {
+				auto it = directoryIndex.find(name);
+				if (it != directoryIndex.end()) return directories[it->second];
+				directoryIndex.emplace(name, directories.size());
+				directories.push_back({ name });
+				return directories.back();
+			}
 			std::vector<FileEntry> files;
 			std::vector<DirectoryEntry> directories;
+			// Position of every subdirectory in directories, so wide trees build in linear time
+			std::unordered_map<std::string, std::size_t> directoryIndex;
 			std::string name;
 			std::uint64_t headerlength, length;
 		};
+		// Data of one file, in-memory sources are used in place and never copied
+		struct Source {
+			int open(const FileEntry& entry) {
+				if (!entry.members.empty()) return openBlock(entry);
+				if (entry.file.isCallback()) {
+					callback = &entry.file.getCallback();
+					return RPK_OK;
+				}
+				if (!entry.file.isOnDisk()) {
+					memory = entry.file.getData();
+					return RPK_OK;
+				}
+				if (!file.openRead(entry.file.getPath())) {
+					RPK_ERROR("Couldn't open file '" + entry.name + "'");
+					return RPK_COULDNT_OPEN_FILE;
+				}
+				return RPK_OK;
+			}
+			// Pointer to length bytes at offset, read into buffer for files on disk
+			const char* read(std::uint64_t offset, std::size_t length, platform::Buffer& buffer, const FileEntry& entry) const {
+				if (memory) return memory + offset;
+				if (callback) return produce(offset, length, buffer.getData(), entry) ? buffer.getData() : nullptr;
+				if (file.readAt(offset, buffer.getData(), length) != length) {
+					RPK_ERROR("Couldn't read file '" + entry.name + "'");
+					return nullptr;
+				}
+				return buffer.getData();
+			}
+			// Callbacks can only be read front to back, the offset is just checked
+			bool produce(std::uint64_t offset, std::size_t length, char* dst, const FileEntry& entry) const {
+				for (std::size_t done = 0; done < length;) {
+					const std::size_t read = offset == produced ? (*callback)(dst + done, length - done) : 0;
+					if (read == 0 || read == RPK_READ_FAILED || read > length - done) {
+						RPK_ERROR("Couldn't read file '" + entry.name + "'");
+						return false;
+					}
+					done += read;
+				}
+				produced += length;
+				return true;
+			}
+			// Solid blocks are put together in memory, they are limited to RPK_V2_MAX_SOLID_BLOCK_SIZE
+			int openBlock(const FileEntry& entry) {
+				owned.assign((std::size_t)entry.length, 0x00);
+				std::size_t offset = 0;
+				for (auto member : entry.members) {
+					Source source;
+					int status = source.open(*member);
+					if (status != RPK_OK) return status;
+					const std::size_t length = (std::size_t)member->length;
+					if (source.memory) {
+						std::memcpy(&owned[offset], source.memory, length);
+					}
+					else if (source.callback) {
+						if (!source.produce(0, length, &owned[offset], *member)) return RPK_COULDNT_OPEN_FILE;
+					}
+					else if (source.file.readAt(0, &owned[offset], length) != length) {
+						RPK_ERROR("Couldn't read file '" + member->name + "'");
+						return RPK_COULDNT_OPEN_FILE;
+					}
+					offset += length;
+				}
+				memory = owned.data();
+				return RPK_OK;
+			}
+			platform::File file;
+			const char* memory = nullptr;
+			const ReadCallback* callback = nullptr;
+			// Bytes taken from the callback so far
+			mutable std::uint64_t produced = 0;
+			std::string owned;
+		};
+		// Writes payloads with positional writes on any number of threads. With fixed offsets every job
+		// already knows its place (version 1), otherwise jobs are placed back to back from the start
+		// offset in job order. Workers read and compress their job while earlier jobs are still being
+		// placed, so the layout is the same for any thread count.
+		struct PayloadWriter {
+			PayloadWriter(const platform::File& out, std::vector<PayloadJob>& jobs, bool fixedOffsets, std::uint64_t start,
+				std::uint32_t alignment = 0, std::uint64_t alignmentThreshold = 0, bool checksums = false)
+				: out(out), jobs(jobs), fixedOffsets(fixedOffsets), alignment(alignment), alignmentThreshold(alignmentThreshold),
+				checksums(checksums), cursor(start)
+			{}
+			int run(std::size_t threads) {
+				ThreadPool::run(threads, jobs.size(), [this]() {
+					// Allocated once per worker and reused for every file
+					platform::Buffer buffer;
+					std::string encoded;
+					for (;;) {
+						if (status != RPK_OK) return;
+						std::size_t index = nextJob++;
+						if (index >= jobs.size()) return;
+						int jobStatus = writeJob(index, buffer, encoded);
+						if (jobStatus != RPK_OK) {
+							fail(jobStatus);
+							return;
+						}
+					}
+				});
+				return status;
+			}
+			// End of the last placed payload
+			std::uint64_t getEnd() const { return cursor; }
+		private:
+			int writeJob(std::size_t index, platform::Buffer& buffer, std::string& encoded) {
+				PayloadJob& job = jobs[index];
+				const FileEntry& entry = *job.file;
+				Source source;
+				int sourceStatus = source.open(entry);
+				if (sourceStatus != RPK_OK) return sourceStatus;
+				const std::uint64_t length = entry.length;
+				if (fixedOffsets) return copy(source, job.begin, length, buffer, entry, job.checksum);
+				if (entry.compression.codec == RPK_CODEC_NONE) {
+					if (!place(index, length)) return RPK_OK;
+					return copy(source, job.begin, length, buffer, entry, job.checksum);
+				}
+				if (entry.compression.codec != RPK_CODEC_LZ4) {
+					RPK_ERROR("Unsupported codec for file '" + entry.name + "'");
+					return RPK_UNSUPPORTED_CODEC;
+				}
+				// The first chunk decides whether compressing is worth it, if it doesn't shrink the file is stored as is
+				std::size_t chunk = (std::size_t)std::min<std::uint64_t>(RPK_COMPRESSION_CHUNK_SIZE, length);
+				const char* data = source.read(0, chunk, buffer, entry);
+				if (!data) return RPK_COULDNT_OPEN_FILE;
+				encoded.clear();
+				bool shrunk = length > 0 && compression::encodeChunk(data, chunk, encoded, entry.compression.level)
+					&& encoded.length() < chunk;
+				if (!shrunk) {
+					if (!place(index, length)) return RPK_OK;
+					// Callbacks can't be read twice, so the chunk read above is written first
+					return copy(source, job.begin, length, buffer, entry, job.checksum, data, chunk);
+				}
+				job.codec = entry.compression.codec;
+				// Until all earlier jobs are placed the compressed chunks are collected in encoded. Once it is the
+				// job's turn, or maxBufferedLength is reached and it waits for it, they are streamed to their final
+				// position. A worker never holds more than that, whatever the size of the file
+				bool streaming = false;
+				std::uint64_t begin = 0, position = 0;
+				for (std::uint64_t done = chunk;;) {
+					if (!streaming && (isTurn(index, position) || encoded.length() >= maxBufferedLength)) {
+						if (!waitTurn(index, position)) return RPK_OK;
+						begin = position;
+						streaming = true;
+					}
+					if (streaming) {
+						if (!write(position, encoded.data(), encoded.length())) return RPK_COULDNT_OPEN_FILE;
+						if (checksums) job.checksum = crc32c(job.checksum, encoded.data(), encoded.length());
+						position += encoded.length();
+						encoded.clear();
+					}
+					if (done >= length) break;
+					chunk = (std::size_t)std::min<std::uint64_t>(RPK_COMPRESSION_CHUNK_SIZE, length - done);
+					if (!(data = source.read(done, chunk, buffer, entry))) return RPK_COULDNT_OPEN_FILE;
+					compression::encodeChunk(data, chunk, encoded, entry.compression.level);
+					done += chunk;
+				}
+				if (streaming) {
+					place(index, position - begin);
+					return RPK_OK;
+				}
+				if (!place(index, encoded.length())) return RPK_OK;
+				if (checksums) job.checksum = crc32c(0, encoded.data(), encoded.length());
+				if (!write(job.begin, encoded.data(), encoded.length())) return RPK_COULDNT_OPEN_FILE;
+				return RPK_OK;
+			}
+			// Copies a whole source to target, files on disk are copied inside the kernel unless they need a checksum
+			// head holds the first headLength bytes if they were read already
+			int copy(const Source& source, std::uint64_t target, std::uint64_t length, platform::Buffer& buffer, const FileEntry& entry, std::uint32_t& checksum,
+				const char* head = nullptr, std::size_t headLength = 0) {
+				if (source.memory) {
+					if (checksums) checksum = crc32c(0, source.memory, (std::size_t)length);
+					if (!write(target, source.memory, (std::size_t)length)) return RPK_COULDNT_OPEN_FILE;
+					return RPK_OK;
+				}
+				if (!checksums && !source.callback) {
+					if (!source.file.copyTo(0, out, target, length, buffer)) {
+						RPK_ERROR("Couldn't copy file '" + entry.name + "'");
+						return RPK_COULDNT_OPEN_FILE;
+					}
+					return RPK_OK;
+				}
+				checksum = 0;
+				std::uint64_t done = 0;
+				if (head) {
+					if (checksums) checksum = crc32c(0, head, headLength);
+					if (!write(target, head, headLength)) return RPK_COULDNT_OPEN_FILE;
+					done = headLength;
+				}
+				while (done < length) {
+					std::size_t chunk = (std::size_t)std::min<std::uint64_t>(buffer.getLength(), length - done);
+					const char* data = source.read(done, chunk, buffer, entry);
+					if (!data) return RPK_COULDNT_OPEN_FILE;
+					if (checksums) checksum = crc32c(checksum, data, chunk);
+					if (!write(target + done, data, chunk)) return RPK_COULDNT_OPEN_FILE;
+					done += chunk;
+				}
+				return RPK_OK;
+			}
+			bool write(std::uint64_t offset, const char* src, std::size_t length) {
+				if (!out.writeAt(offset, src, length)) {
+					RPK_ERROR("Couldn't write output file");
+					return false;
+				}
+				return true;
+			}
+			// Waits until all earlier jobs are placed, then gives the job its range
+			bool place(std::size_t index, std::uint64_t length) {
+				std::unique_lock<std::mutex> lock(mutex);
+				turn.wait(lock, [&]() { return placed == index || status != RPK_OK; });
+				if (status != RPK_OK) return false;
+				jobs[index].begin = getStart(index);
+				cursor = jobs[index].begin + length;
+				jobs[index].end = cursor;
+				placed++;
+				turn.notify_all();
+				return true;
+			}
+			bool isTurn(std::size_t index, std::uint64_t& position) {
+				std::lock_guard<std::mutex> lock(mutex);
+				position = getStart(index);
+				return placed == index;
+			}
+			// Waits until all earlier jobs are placed without placing the job, false if the writer failed
+			bool waitTurn(std::size_t index, std::uint64_t& position) {
+				std::unique_lock<std::mutex> lock(mutex);
+				turn.wait(lock, [&]() { return placed == index || status != RPK_OK; });
+				if (status != RPK_OK) return false;
+				position = getStart(index);
+				return true;
+			}
+			// Where the job starts if it is placed now, padding is left as a hole
+			std::uint64_t getStart(std::size_t index) const {
+				if (alignment <= 1 || jobs[index].file->length < alignmentThreshold) return cursor;
+				return (cursor + alignment - 1) & ~(std::uint64_t)(alignment - 1);
+			}
+			void fail(int error) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (status == RPK_OK) status = error;
+				turn.notify_all();
+			}
+
+			// Compressed data a job collects before its turn, 4 MiB per worker
+			static constexpr std::size_t maxBufferedLength = 16 * RPK_COMPRESSION_CHUNK_SIZE;
+
+			const platform::File& out;
+			std::vector<PayloadJob>& jobs;
+			const bool fixedOffsets;
+			const std::uint32_t alignment;
+			const std::uint64_t alignmentThreshold;
+			const bool checksums;
+			std::uint64_t cursor;
+			std::size_t placed = 0;
+			std::atomic<std::size_t> nextJob = 0;
+			std::atomic<int> status = RPK_OK;
+			std::mutex mutex;
+			std::condition_variable turn;
+		};
 		DirectoryEntry base = DirectoryEntry("");
-		Structure(PackageCreator& creator)
+		// Normalized, sorted and unique
+		std::vector<std::string> deletions;
+		// RPK_INVALID_PATH if a path could leave the directory it is extracted to, nothing is written then
+		int status = RPK_OK;
+		Structure(const PackageCreator& creator, const CreateOptions& options)
 		{
+			addEntries(creator, options);
+		}
+		// Moves the sources out of the creator instead of copying them
+		Structure(PackageCreator&& creator, const CreateOptions& options)
+		{
+			addEntries(std::move(creator), options);
+		}
+		template<typename Creator>
+		void addEntries(Creator&& creator, const CreateOptions& options)
+		{
+			// File&& for a creator that was moved in, const File& otherwise
+			using FileReference = std::conditional_t<std::is_const_v<std::remove_reference_t<Creator>>, const File&, File&&>;
+			for (auto& path : creator.deletions) {
+				std::string normalized = format::normalizePath(path);
+				if (normalized.empty()) continue;
+				if (!format::isSafePath(normalized)) {
+					RPK_ERROR("Invalid path '" + path + "'");
+					status = RPK_INVALID_PATH;
+					return;
+				}
+				deletions.push_back(std::move(normalized));
+			}
+			std::sort(deletions.begin(), deletions.end());
+			deletions.erase(std::unique(deletions.begin(), deletions.end()), deletions.end());
 			for (auto& entry : creator.entry) {
 				DirectoryEntry* current = &base;
 				std::vector<std::string> fileNames = util::convertPath(entry.path);
-				for (const auto& name : fileNames) {
-					if (fileNames.back() == name) {
-						if (entry.file.has_value())
-							current->files.push_back({ entry.file.value(), name });
-						else
-							current->directories.push_back(name);
-					}
-					else {
+				if (fileNames.empty()) continue;
+				// "..", "." or a drive would let extraction write outside of the target directory
+				if (!std::all_of(fileNames.begin(), fileNames.end(), [](const std::string& name) { return format::isSafeName(name); })) {
+					RPK_ERROR("Invalid path '" + entry.path + "'");
+					status = RPK_INVALID_PATH;
+					return;
+				}
+				for (std::size_t i = 0; i + 1 < fileNames.size(); i++) {
+					current = &current->getDirectory(fileNames[i]);
+				}
+				if (entry.file.has_value())
+					current->files.push_back({ static_cast<FileReference>(entry.file.value()), fileNames.back(), getCompression(creator, entry, options) });
+				else
+					current->getDirectory(fileNames.back());
+			}
+		}
+		// Gives byte-identical files the same contentId. Only files whose length matches another file
+		// are hashed, equal hashes are confirmed by comparing the contents
+		int findDuplicates(std::size_t threads)
+		{
+			std::vector<FileEntry*> files;
+			std::vector<DirectoryEntry*> pending = { &base };
+			while (!pending.empty()) {
+				DirectoryEntry* dir = pending.back();
+				pending.pop_back();
+				for (auto& file : dir->files) files.push_back(&file);
+				for (auto& sub : dir->directories) pending.push_back(&sub);
+			}
+			std::unordered_map<std::uint64_t, std::vector<std::size_t>> byLength;
+			// Callbacks can't be read twice, their files always keep their own payload
+			for (std::size_t i = 0; i < files.size(); i++) {
+				if (!files[i]->file.isCallback()) byLength[files[i]->length].push_back(i);
+			}
+			std::vector<std::size_t> candidates;
+			for (auto& group : byLength) {
+				if (group.second.size() > 1) candidates.insert(candidates.end(), group.second.begin(), group.second.end());
+			}
+
+			std::vector<std::uint64_t> hashes(files.size());
+			std::atomic<std::size_t> next = 0;
+			std::atomic<int> status = RPK_OK;
+			ThreadPool::run(threads, candidates.size(), [&]() {
+				platform::Buffer buffer;
+				for (std::size_t i = next++; i < candidates.size() && status == RPK_OK; i = next++) {
+					int hashStatus = hashFile(*files[candidates[i]], hashes[candidates[i]], buffer);
+					if (hashStatus != RPK_OK) status = hashStatus;
+				}
+			});
+			if (status != RPK_OK) return status;
+
+			std::vector<std::vector<std::size_t>> buckets;
+			for (auto& group : byLength) {
+				if (group.second.size() < 2) continue;
+				std::unordered_map<std::uint64_t, std::vector<std::size_t>> byHash;
+				for (std::size_t index : group.second) byHash[hashes[index]].push_back(index);
+				for (auto& bucket : byHash) {
+					if (bucket.second.size() > 1) buckets.push_back(std::move(bucket.second));
+				}
+			}
+			next = 0;
+			ThreadPool::run(threads, buckets.size(), [&]() {
+				platform::Buffer first, second;
+				for (std::size_t i = next++; i < buckets.size() && status == RPK_OK; i = next++) {
+					// Every distinct content in the bucket keeps one representative, its index is the content id
+					std::vector<std::size_t> representatives;
+					for (std::size_t index : buckets[i]) {
 						bool found = false;
-						for (auto& entryEntry : current->directories) {
-							if (entryEntry.name == name) {
-								current = &entryEntry;
+						for (std::size_t representative : representatives) {
+							bool equal = false;
+							int compareStatus = compareFiles(*files[representative], *files[index], equal, first, second);
+							if (compareStatus != RPK_OK) {
+								status = compareStatus;
+								return;
+							}
+							if (equal) {
+								files[index]->contentId = representative;
 								found = true;
+								break;
 							}
 						}
 						if (!found) {
-							current->directories.push_back({ name });
-							current = &(current->directories.back());
+							representatives.push_back(index);
+							files[index]->contentId = index;
 						}
 					}
 				}
+			});
+			return status;
+		}
+		static int hashFile(const FileEntry& entry, std::uint64_t& hash, platform::Buffer& buffer)
+		{
+			Source source;
+			int status = source.open(entry);
+			if (status != RPK_OK) return status;
+			Xxh64 hasher;
+			for (std::uint64_t done = 0; done < entry.length;) {
+				std::size_t chunk = (std::size_t)std::min<std::uint64_t>(buffer.getLength(), entry.length - done);
+				const char* data = source.read(done, chunk, buffer, entry);
+				if (!data) return RPK_COULDNT_OPEN_FILE;
+				hasher.update(data, chunk);
+				done += chunk;
+			}
+			hash = hasher.digest();
+			return RPK_OK;
+		}
+		static int compareFiles(const FileEntry& a, const FileEntry& b, bool& equal, platform::Buffer& firstBuffer, platform::Buffer& secondBuffer)
+		{
+			Source first, second;
+			int status = first.open(a);
+			if (status == RPK_OK) status = second.open(b);
+			if (status != RPK_OK) return status;
+			equal = a.length == b.length;
+			for (std::uint64_t done = 0; equal && done < a.length;) {
+				std::size_t chunk = (std::size_t)std::min<std::uint64_t>(firstBuffer.getLength(), a.length - done);
+				const char* firstData = first.read(done, chunk, firstBuffer, a);
+				const char* secondData = second.read(done, chunk, secondBuffer, b);
+				if (!firstData || !secondData) return RPK_COULDNT_OPEN_FILE;
+				equal = std::memcmp(firstData, secondData, chunk) == 0;
+				done += chunk;
 			}
+			return RPK_OK;
+		}
+		// Per file settings win over the creator's extension settings, which win over the options
+		static Compression getCompression(const PackageCreator& creator, const PackageCreator::Entry& entry, const CreateOptions& options)
+		{
+			if (entry.compression.has_value()) return entry.compression.value();
+			std::string extension = util::getExtension(entry.path);
+			auto it = creator.extensionCompression.find(extension);
+			if (it != creator.extensionCompression.end()) return it->second;
+			it = options.extensionCompression.find(extension);
+			if (it != options.extensionCompression.end()) return it->second;
+			return options.compression;
 		}
 	};
 	/* Structure definition end */
 	int package::createArchiveFromDir(const std::string& dirPath, const std::string& archivePath, bool overrideOldTarget)
+	{
+		return createArchiveFromDir(dirPath, archivePath, CreateOptions(), overrideOldTarget);
+	}
+	int package::createArchiveFromDir(const std::string& dirPath, const std::string& archivePath, const CreateOptions& options, bool overrideOldTarget)
 	{
 		if (!std::filesystem::exists(dirPath)) {
 			/* The input doesn't exist */
@@ -143,365 +627,405 @@ namespace rvn {
 				return RPK_OUTPUT_EXISTS;
 			}
 			PackageCreator creator;
-			for (auto& file : std::filesystem::recursive_directory_iterator(dirPath)) {
-				if (file.is_directory()) {
-					creator.addDirectory(std::filesystem::relative(file.path(), dirPath).string());
-				}
-				if (file.is_regular_file()) {
-					creator.addFile(std::filesystem::relative(file.path().string(), dirPath).string(), File(file.path().filename().string(), file.path().string()));
-				}
-			}
-			Structure structure(creator);
-			structure.base.calculateLength();
-			return createArchiveFromStructure(structure, archivePath);
+			int status = addDirToCreator(creator, dirPath, options.threads);
+			if (status != RPK_OK) return status;
+			Structure structure(std::move(creator), options);
+			return createArchiveFromStructure(structure, archivePath, options);
 		}
 		return RPK_OK;
 	}
 	int package::createArchive(const PackageCreator& package, const std::string& archivePath, bool overrideOldTarget)
+	{
+		return createArchive(package, archivePath, CreateOptions(), overrideOldTarget);
+	}
+	int package::createArchive(const PackageCreator& package, const std::string& archivePath, const CreateOptions& options, bool overrideOldTarget)
 	{
 		if (std::filesystem::exists(archivePath) && !overrideOldTarget) {
 			/* There is already a file with the path of the output */
 			RPK_ERROR("Output target already exists. This error can be disabled by setting overrideOldTarget to true");
 			return RPK_OUTPUT_EXISTS;
 		}
-		PackageCreator pk = package;
-		Structure structure(pk);
-		structure.base.calculateLength();
-		return createArchiveFromStructure(structure, archivePath);
+		Structure structure(package, options);
+		return createArchiveFromStructure(structure, archivePath, options);
 	}
-	int package::extractFile(const std::string& archPath, const std::string& filePath, const std::string& targetPath)
+	int package::createArchive(PackageCreator&& package, const std::string& archivePath, bool overrideOldTarget)
 	{
-		if (!std::filesystem::exists(archPath)) {
-			RPK_ERROR("Input doesnt exist");
-			return RPK_ARCHIVE_DOESNT_EXIST;
-		} 
-		else if (std::filesystem::exists(targetPath)) {
-			RPK_ERROR("Target already exists");
+		return createArchive(std::move(package), archivePath, CreateOptions(), overrideOldTarget);
+	}
+	int package::createArchive(PackageCreator&& package, const std::string& archivePath, const CreateOptions& options, bool overrideOldTarget)
+	{
+		if (std::filesystem::exists(archivePath) && !overrideOldTarget) {
+			/* There is already a file with the path of the output */
+			RPK_ERROR("Output target already exists. This error can be disabled by setting overrideOldTarget to true");
 			return RPK_OUTPUT_EXISTS;
 		}
-		else if (std::filesystem::is_directory(archPath)) {
-			RPK_ERROR("Input cant be a directory");
-			return RPK_INPUT_IS_DIRECTORY;
+		Structure structure(std::move(package), options);
+		return createArchiveFromStructure(structure, archivePath, options);
+	}
+	int package::addDirToCreator(PackageCreator& creator, const std::string& dirPath, std::size_t threads)
+	{
+		ScannedDirectory root;
+		int status = scanDirectory(dirPath, threads, root);
+		if (status != RPK_OK) return status;
+		// Depth first, every directory before its contents. The sizes from the scan spare the tree builder its stats
+		std::vector<const ScannedDirectory*> stack = { &root };
+		while (!stack.empty()) {
+			const ScannedDirectory* directory = stack.back();
+			stack.pop_back();
+			if (!directory->path.empty()) creator.addDirectory(directory->path);
+			const std::string prefix = directory->path.empty() ? "" : directory->path + '/';
+			for (auto& file : directory->files) {
+				std::string path = prefix + file.name;
+				creator.entry.push_back({ path, File(file.name, dirPath + '/' + path, file.size), std::nullopt });
+			}
+			for (auto it = directory->directories.rbegin(); it != directory->directories.rend(); it++) stack.push_back(&*it);
 		}
-		else {
-			std::ifstream in(archPath, std::ios::binary);
-			if (in) {
-				std::string buffer(RPK_MAGIC_NUMBER_LENGTH, 0x00);
-				in.read(&buffer[0], buffer.length());
-				char cbuffer;
-				if (buffer != RPK_MAGIC_NUMBER) {
-					RPK_ERROR("Input is no Raven Package");
-					return RPK_INPUT_ISNT_RAVEN_PACKAGE;
-				}
-				in.get(cbuffer);
-				if (std::find(supportedExtractVersions.begin(), supportedExtractVersions.end(), (std::uint8_t)cbuffer)
-					== supportedExtractVersions.end()) {
-					RPK_ERROR("Unsupported file version");
-					return RPK_UNSUPPORTED_VERSION;
-				}
-				switch ((std::uint8_t)cbuffer) {
-				case RPK_VERSION_1: {
-					std::string filePathCopy = filePath;
-					std::size_t position = 0;
-					while (filePathCopy.find('\\') != filePathCopy.npos) {
-						position = filePathCopy.find('\\');
-						filePathCopy = filePathCopy.replace(position, 1, "/");
-					}
-					std::vector<std::string> fileNames = util::split(filePathCopy, "/");
-					for (auto& file : fileNames) {
-						if (file.empty()) { RPK_ERROR("Invalid path"); return RPK_INVALID_PATH; }
-					}
-					std::uint64_t begin = in.tellg();
-					for (auto& file : fileNames) {
-						in.seekg(begin);
-						buffer = std::string(2, 0x00);
-						in.read(&buffer[0], buffer.length());
-						std::uint16_t fileCount = util::convertCharsToUint16(buffer.c_str());
-						for (std::uint16_t i = 0; i < fileCount; i++) {
-							in.get(cbuffer);
-							bool isFile = cbuffer & RPK_TRAIT_IS_FILE;
-							in.get(cbuffer);
-							buffer = std::string((std::uint8_t)cbuffer, 0x00);
-							in.read(&buffer[0], buffer.length());
-							if (file != buffer) {
-								if (isFile) {
-									in.seekg(in.tellg() + std::streamoff(16));
-								}
-								else {
-									in.seekg(in.tellg() + std::streamoff(8));
-								}
-							}
-							if ((file == buffer) && isFile) {
-								buffer = std::string(8, 0x00);
-								in.read(&buffer[0], buffer.length());
-								std::uint64_t beg = util::convertCharsToUint64(buffer.c_str());
-								in.read(&buffer[0], buffer.length());
-								std::uint64_t end = util::convertCharsToUint64(buffer.c_str());
-								std::ofstream out(targetPath, std::ios::binary);
-								std::uint64_t length = (end - beg);
-								std::uint64_t counter = 0;
-								in.seekg(beg);
-								if (out) {
-									std::string buf(BUF_SIZE, 0x00);
-									for (int i = 0; i < (length / BUF_SIZE) + 1; i++) {
-										buf = std::string(length - counter > BUF_SIZE ? BUF_SIZE : length - counter, 0x00);
-										in.read(&buf[0], buf.length());
-										out << buf;
-										counter += buf.length();
-									}
-								}
-								else {
-									RPK_ERROR("Couldn't open output file");
-									return RPK_COULDNT_OPEN_FILE;
-								}
-							}
-							if ((file == buffer) && !isFile) {
-								buffer = std::string(8, 0x00);
-								in.read(&buffer[0], buffer.length());
-								begin = util::convertCharsToUint64(buffer.c_str());
-							}
-						}
-					}
-					break;
+		return RPK_OK;
+	}
+	int package::updateArchive(const std::string& archivePath, const PackageCreator& changes, const std::vector<std::string>& removePaths, const CreateOptions& options)
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Create);
+		ArchiveReader reader;
+		int status = reader.open(archivePath);
+		if (status != RPK_OK) return status;
+		if (reader.getVersion() != RPK_VERSION_2) {
+			RPK_ERROR("Only version 2 archives can be updated");
+			return RPK_UNSUPPORTED_VERSION;
+		}
+		// Solid blocks stay as they are, blocks without files left are dropped by compactArchive
+		std::vector<format::Record> oldRecords;
+		std::vector<format::Block> blocks;
+		reader.getRecords(oldRecords, blocks);
+		std::vector<std::string> deletions = reader.getDeletions();
+		const std::uint64_t oldSize = reader._file->getSize();
+		const std::uint32_t alignment = reader._alignment;
+		const std::uint64_t alignmentThreshold = reader._alignmentThreshold;
+		reader.close();
+
+		/* Merge the old index with the changes, a sorted map puts every parent before its children */
+		struct MergedEntry {
+			format::Record record;
+			Structure::FileEntry* file = nullptr;
+		};
+		std::map<std::string, MergedEntry> merged;
+		for (auto& record : oldRecords) merged[record.path].record = std::move(record);
+		for (auto& removePath : removePaths) {
+			const std::string path = format::normalizePath(removePath);
+			auto it = merged.find(path);
+			if (path.empty() || it == merged.end()) {
+				RPK_ERROR("Path '" + removePath + "' doesn't exist in archive");
+				return RPK_INVALID_PATH;
+			}
+			merged.erase(it);
+			// Everything below the path sorts into one block
+			const std::string prefix = path + "/";
+			auto end = merged.lower_bound(prefix);
+			while (end != merged.end() && end->first.compare(0, prefix.length(), prefix) == 0) end = merged.erase(end);
+		}
+
+		Structure structure(changes, options);
+		if (structure.status != RPK_OK) return structure.status;
+		deletions.insert(deletions.end(), structure.deletions.begin(), structure.deletions.end());
+		std::sort(deletions.begin(), deletions.end());
+		deletions.erase(std::unique(deletions.begin(), deletions.end()), deletions.end());
+		struct PendingDirectory {
+			Structure::DirectoryEntry* dir;
+			std::string path;
+		};
+		std::vector<PendingDirectory> pending = { { &structure.base, "" } };
+		while (!pending.empty()) {
+			PendingDirectory current = pending.back();
+			pending.pop_back();
+			const std::string prefix = current.path.empty() ? "" : current.path + "/";
+			for (auto& file : current.dir->files) {
+				MergedEntry& entry = merged[prefix + file.name];
+				if (!entry.record.path.empty() && !(entry.record.traits & RPK_TRAIT_IS_FILE)) {
+					RPK_ERROR("'" + prefix + file.name + "' is a directory in the archive");
+					return RPK_INVALID_PATH;
 				}
+				entry.record = format::Record();
+				entry.record.path = prefix + file.name;
+				entry.record.traits = RPK_TRAIT_IS_FILE;
+				entry.file = &file;
+			}
+			for (auto& dir : current.dir->directories) {
+				pending.push_back({ &dir, prefix + dir.name });
+				MergedEntry& entry = merged[prefix + dir.name];
+				if (entry.record.traits & RPK_TRAIT_IS_FILE) {
+					RPK_ERROR("'" + prefix + dir.name + "' is a file in the archive");
+					return RPK_INVALID_PATH;
 				}
+				entry.record.path = prefix + dir.name;
 			}
-			else {
-				RPK_ERROR("Couln't open input");
-				return RPK_COULDNT_OPEN_FILE;
+		}
+		// Every parent has to exist as a directory
+		for (auto& entry : merged) {
+			const std::size_t separator = entry.first.find_last_of('/');
+			if (separator == std::string::npos) continue;
+			auto parent = merged.find(entry.first.substr(0, separator));
+			if (parent == merged.end() || (parent->second.record.traits & RPK_TRAIT_IS_FILE)) {
+				RPK_ERROR("Parent of '" + entry.first + "' is no directory in the archive");
+				return RPK_INVALID_PATH;
 			}
 		}
+		if (merged.size() >= RPK_V2_NO_PARENT - 1) {
+			RPK_ERROR("Archive contains too many files and directories");
+			return RPK_TOO_MANY_FILES;
+		}
+
+		std::vector<MergedEntry*> entries;
+		std::unordered_map<std::string, std::uint32_t> indices;
+		for (auto& entry : merged) {
+			if (entry.first.length() > RPK_V2_MAX_PATH_LENGTH) {
+				RPK_ERROR("Path '" + entry.first.substr(0, 64) + "...' is too long");
+				return RPK_INVALID_PATH;
+			}
+			const std::size_t separator = entry.first.find_last_of('/');
+			entry.second.record.parent = separator == std::string::npos ? RPK_V2_NO_PARENT : indices.at(entry.first.substr(0, separator));
+			indices.emplace(entry.first, (std::uint32_t)entries.size());
+			entries.push_back(&entry.second);
+		}
+
+		/* Only the changed payloads are written, behind everything that is already there */
+		platform::File out;
+		if (!out.openReadWrite(archivePath) || out.getSize() != oldSize) {
+			RPK_ERROR("Couldn't open output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		std::vector<Structure::PayloadJob> jobs;
+		std::vector<std::size_t> jobEntries;
+		for (std::size_t i = 0; i < entries.size(); i++) {
+			if (entries[i]->file) jobEntries.push_back(i);
+		}
+		sortByAccess(jobEntries, options, [&](std::size_t i) -> const std::string& { return entries[i]->record.path; });
+		for (std::size_t i : jobEntries) {
+			Structure::PayloadJob job;
+			job.file = entries[i]->file;
+			jobs.push_back(job);
+		}
+		Structure::PayloadWriter writer(out, jobs, false, oldSize, alignment, alignmentThreshold, options.checksums);
+		status = writer.run(options.threads);
+		std::vector<format::Record> records;
+		if (status == RPK_OK) {
+			for (std::size_t i = 0; i < jobs.size(); i++) {
+				format::Record& record = entries[jobEntries[i]]->record;
+				record.begin = jobs[i].begin;
+				record.end = jobs[i].end;
+				if (jobs[i].codec != RPK_CODEC_NONE) {
+					record.traits |= RPK_TRAIT_COMPRESSED;
+					record.codec = jobs[i].codec;
+					record.length = jobs[i].file->length;
+				}
+				if (options.checksums) {
+					record.traits |= RPK_TRAIT_CHECKSUM;
+					record.checksum = jobs[i].checksum;
+				}
+			}
+			records.reserve(entries.size());
+			for (auto entry : entries) records.push_back(std::move(entry->record));
+			const std::uint64_t directoryOffset = writer.getEnd();
+			std::string directory = format::buildDirectory(records, alignment, alignmentThreshold, blocks, deletions);
+			directory += format::buildFooter(directoryOffset, directory);
+			if (!out.writeAt(directoryOffset, directory.data(), directory.length())) {
+				RPK_ERROR("Couldn't write output file");
+				status = RPK_COULDNT_OPEN_FILE;
+			}
+		}
+		// Nothing before the old end was touched, cutting the file there restores the old archive
+		if (status != RPK_OK) out.truncate(oldSize);
+		return status;
+	}
+	int package::updateArchiveFromDir(const std::string& archivePath, const std::string& dirPath, const CreateOptions& options)
+	{
+		if (!std::filesystem::is_directory(dirPath)) {
+			RPK_ERROR("Input path is not a directory");
+			return RPK_INPUT_NOT_DIRECTORY;
+		}
+		PackageCreator creator;
+		int status = addDirToCreator(creator, dirPath, options.threads);
+		if (status != RPK_OK) return status;
+		return updateArchive(archivePath, creator, {}, options);
+	}
+	int package::compactArchive(const std::string& archivePath)
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Create);
+		ArchiveReader reader;
+		int status = reader.open(archivePath);
+		if (status != RPK_OK) return status;
+		if (reader.getVersion() != RPK_VERSION_2) {
+			RPK_ERROR("Only version 2 archives can be compacted");
+			return RPK_UNSUPPORTED_VERSION;
+		}
+		std::vector<format::Record> records;
+		std::vector<format::Block> blocks;
+		reader.getRecords(records, blocks);
+		const std::uint32_t alignment = reader._alignment;
+		const std::uint64_t alignmentThreshold = reader._alignmentThreshold;
+
+		// A new file of our own next to the archive, nothing that already exists is truncated
+		std::string tempPath;
+		platform::File out;
+		if (!out.openTemp(archivePath, tempPath)) {
+			RPK_ERROR("Couldn't open output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		std::string header = RPK_MAGIC_NUMBER;
+		header.push_back((char)RPK_VERSION_2);
+		bool written = out.writeAt(0, header.data(), header.length());
+
+		/* Payloads and solid blocks keep their order, ranges shared by several files are copied once */
+		struct Payload {
+			std::uint64_t begin;
+			std::uint64_t end;
+			// Decoded length, decides about the alignment
+			std::uint64_t length;
+			// Record or block index
+			std::size_t index;
+			bool isBlock;
+		};
+		std::vector<Payload> payloads;
+		std::vector<bool> usedBlocks(blocks.size(), false);
+		for (std::size_t i = 0; i < records.size(); i++) {
+			const format::Record& record = records[i];
+			if (!(record.traits & RPK_TRAIT_IS_FILE)) continue;
+			if (record.traits & RPK_TRAIT_SOLID) {
+				usedBlocks[record.block] = true;
+				continue;
+			}
+			const std::uint64_t length = (record.traits & RPK_TRAIT_COMPRESSED) ? record.length : record.end - record.begin;
+			payloads.push_back({ record.begin, record.end, length, i, false });
+		}
+		for (std::size_t i = 0; i < blocks.size(); i++) {
+			if (usedBlocks[i]) payloads.push_back({ blocks[i].begin, blocks[i].end, blocks[i].length, i, true });
+		}
+		std::sort(payloads.begin(), payloads.end(), [](const Payload& a, const Payload& b) {
+			return a.begin != b.begin ? a.begin < b.begin : a.end < b.end;
+		});
+		// Blocks without files are dropped, the others are numbered in their new order
+		std::vector<format::Block> newBlocks;
+		std::vector<std::uint32_t> blockIndices(blocks.size(), RPK_V2_NO_BLOCK);
+		platform::Buffer buffer;
+		std::uint64_t position = header.length();
+		std::uint64_t lastBegin = 0, lastEnd = 0, newBegin = 0;
+		for (std::size_t i = 0; i < payloads.size() && written; i++) {
+			const Payload& payload = payloads[i];
+			if (i == 0 || payload.begin != lastBegin || payload.end != lastEnd) {
+				lastBegin = payload.begin;
+				lastEnd = payload.end;
+				if (alignment > 1 && payload.length >= alignmentThreshold) position = (position + alignment - 1) & ~(std::uint64_t)(alignment - 1);
+				newBegin = position;
+				written = reader._file->copyTo(payload.begin, out, position, payload.end - payload.begin, buffer);
+				position += payload.end - payload.begin;
+			}
+			if (payload.isBlock) {
+				blockIndices[payload.index] = (std::uint32_t)newBlocks.size();
+				newBlocks.push_back(blocks[payload.index]);
+				newBlocks.back().begin = newBegin;
+				newBlocks.back().end = newBegin + (payload.end - payload.begin);
+				continue;
+			}
+			format::Record& record = records[payload.index];
+			record.end = newBegin + (record.end - record.begin);
+			record.begin = newBegin;
+		}
+		for (auto& record : records) {
+			if (record.traits & RPK_TRAIT_SOLID) record.block = blockIndices[record.block];
+		}
+		if (written) {
+			std::string directory = format::buildDirectory(records, alignment, alignmentThreshold, newBlocks, reader.getDeletions());
+			directory += format::buildFooter(position, directory);
+			written = out.writeAt(position, directory.data(), directory.length());
+		}
+		out.close();
+		reader.close();
+		std::error_code error;
+		if (written) std::filesystem::rename(tempPath, archivePath, error);
+		if (!written || error) {
+			RPK_ERROR("Couldn't write compacted archive");
+			std::filesystem::remove(tempPath, error);
+			return RPK_COULDNT_OPEN_FILE;
+		}
 		return RPK_OK;
 	}
+	int package::extractFile(const std::string& archPath, const std::string& filePath, const std::string& targetPath)
+	{
+		ArchiveReader reader;
+		int status = reader.open(archPath);
+		if (status != RPK_OK) return status;
+		return reader.extractFile(filePath, targetPath);
+	}
 	int package::extractFile(const std::string& archPath, const std::string& filePath)
 	{
 		return extractFile(archPath, filePath, std::filesystem::path(filePath).filename().string());
 	}
 	std::pair<int, std::shared_ptr<std::string>> package::extractToString(const std::string& archPath, const std::string& filePath)
 	{
-		std::pair<int, std::shared_ptr<std::string>> ret;
-		if (!std::filesystem::exists(archPath)) {
-			RPK_ERROR("Input doesnt exist");
-			ret.first = RPK_ARCHIVE_DOESNT_EXIST;
-			return ret;
-		}
-		else if (std::filesystem::is_directory(archPath)) {
-			RPK_ERROR("Input cant be a directory");
-			ret.first = RPK_INPUT_IS_DIRECTORY;
-			return ret;
+		ArchiveReader reader;
+		int status = reader.open(archPath);
+		if (status != RPK_OK) return { status, nullptr };
+		return reader.extractToString(filePath);
+	}
+	int package::readAccessTrace(const std::string& tracePath, std::vector<std::string>& paths)
+	{
+		std::ifstream in(tracePath, std::ios::binary);
+		if (!in) {
+			RPK_ERROR("Couldn't open access trace");
+			return RPK_COULDNT_OPEN_FILE;
 		}
-		else {
-			std::ifstream in(archPath, std::ios::binary);
-			if (in) {
-				std::string buffer(RPK_MAGIC_NUMBER_LENGTH, 0x00);
-				in.read(&buffer[0], buffer.length());
-				char cbuffer;
-				if (buffer != RPK_MAGIC_NUMBER) {
-					RPK_ERROR("Input is no Raven Package");
-					ret.first = RPK_INPUT_ISNT_RAVEN_PACKAGE;
-					return ret;
-				}
-				in.get(cbuffer);
-				if (std::find(supportedExtractVersions.begin(), supportedExtractVersions.end(), (std::uint8_t)cbuffer)
-					== supportedExtractVersions.end()) {
-					RPK_ERROR("Unsupported file version");
-					ret.first = RPK_UNSUPPORTED_VERSION;
-					return ret;
-				}
-				switch ((std::uint8_t)cbuffer) {
-				case RPK_VERSION_1: {
-					std::string filePathCopy = filePath;
-					std::size_t position = 0;
-					while (filePathCopy.find('\\') != filePathCopy.npos) {
-						position = filePathCopy.find('\\');
-						filePathCopy = filePathCopy.replace(position, 1, "/");
-					}
-					std::vector<std::string> fileNames = util::split(filePathCopy, "/");
-					for (auto& file : fileNames) {
-						if (file.empty()) { RPK_ERROR("Invalid path"); ret.first = RPK_INVALID_PATH; return ret; }
-					}
-					std::uint64_t begin = in.tellg();
-					for (auto& file : fileNames) {
-						in.seekg(begin);
-						buffer = std::string(2, 0x00);
-						in.read(&buffer[0], buffer.length());
-						std::uint16_t fileCount = util::convertCharsToUint16(buffer.c_str());
-						for (std::uint16_t i = 0; i < fileCount; i++) {
-							in.get(cbuffer);
-							bool isFile = cbuffer & RPK_TRAIT_IS_FILE;
-							in.get(cbuffer);
-							buffer = std::string((std::uint8_t)cbuffer, 0x00);
-							in.read(&buffer[0], buffer.length());
-							if (file != buffer) {
-								if (isFile) {
-									in.seekg(in.tellg() + std::streamoff(16));
-								}
-								else {
-									in.seekg(in.tellg() + std::streamoff(8));
-								}
-							}
-							if ((file == buffer) && isFile) {
-								buffer = std::string(8, 0x00);
-								in.read(&buffer[0], buffer.length());
-								std::uint64_t beg = util::convertCharsToUint64(buffer.c_str());
-								in.read(&buffer[0], buffer.length());
-								std::uint64_t end = util::convertCharsToUint64(buffer.c_str());
-								std::ostringstream out;
-								std::uint64_t length = (end - beg);
-								std::uint64_t counter = 0;
-								in.seekg(beg);
-								if (out) {
-									std::string buf(BUF_SIZE, 0x00);
-									for (int i = 0; i < (length / BUF_SIZE) + 1; i++) {
-										buf = std::string(length - counter > BUF_SIZE ? BUF_SIZE : length - counter, 0x00);
-										in.read(&buf[0], buf.length());
-										out << buf;
-										counter += buf.length();
-									}
-									ret.second = std::make_shared<std::string>(out.str());
-								}
-								else {
-									RPK_ERROR("Couldn't open output file");
-									ret.first = RPK_COULDNT_OPEN_FILE;
-									return ret;
-								}
-							}
-							if ((file == buffer) && !isFile) {
-								buffer = std::string(8, 0x00);
-								in.read(&buffer[0], buffer.length());
-								begin = util::convertCharsToUint64(buffer.c_str());
-							}
-						}
-					}
-					break;
-				}
-				}
-			}
-			else {
-				RPK_ERROR("Couln't open input");
-				ret.first = RPK_COULDNT_OPEN_FILE;
-				return ret;
-			}
+		paths.clear();
+		std::string line;
+		while (std::getline(in, line)) {
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (!line.empty()) paths.push_back(line);
 		}
-		ret.first = RPK_OK;
-		return ret;
+		return RPK_OK;
 	}
 	Entries package::getEntriesAt(const std::string& archPath, const std::string& filePath)
 	{
+		ArchiveReader reader;
 		Entries ret;
-		std::vector<Entry>& entries = ret.entries;
-		int& status = ret.status;
-		if (!std::filesystem::exists(archPath)) {
-			RPK_ERROR("Input doesnt exist");
-			status = RPK_ARCHIVE_DOESNT_EXIST;
-		}
-		else if (std::filesystem::is_directory(archPath)) {
-			RPK_ERROR("Input cant be a directory");
-			status = RPK_INPUT_IS_DIRECTORY;
+		ret.status = reader.open(archPath);
+		if (ret.status != RPK_OK) return ret;
+		return reader.getEntriesAt(filePath);
+	}
+	int package::createArchiveFromStructure(Structure& structure, const std::string& archivePath, const CreateOptions& options)
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Create);
+		if (structure.status != RPK_OK) return structure.status;
+		if (options.deduplicate) {
+			int status = structure.findDuplicates(options.threads);
+			if (status != RPK_OK) return status;
 		}
-		else {
-			std::ifstream in(archPath, std::ios::binary);
-			if (in) {
-				std::string buffer(RPK_MAGIC_NUMBER_LENGTH, 0x00);
-				in.read(&buffer[0], buffer.length());
-				char cbuffer;
-				if (buffer != RPK_MAGIC_NUMBER) {
-					RPK_ERROR("Input is no Raven Package");
-					status = RPK_INPUT_ISNT_RAVEN_PACKAGE; return ret;
-				}
-				in.get(cbuffer);
-				if (std::find(supportedExtractVersions.begin(), supportedExtractVersions.end(), (std::uint8_t)cbuffer)
-					== supportedExtractVersions.end()) {
-					RPK_ERROR("Unsupported file version");
-					status = RPK_UNSUPPORTED_VERSION; return ret;
-				}
-				switch ((std::uint8_t)cbuffer) {
-				case RPK_VERSION_1: {
-					std::string filePathCopy = filePath;
-					std::size_t position = 0;
-					//bool exists = false;
-					while (filePathCopy.find('\\') != filePathCopy.npos) {
-						position = filePathCopy.find('\\');
-						filePathCopy = filePathCopy.replace(position, 1, "/");
-					}
-					std::vector<std::string> fileNames = util::split(filePathCopy, "/");
-					for (auto& file : fileNames) {
-						if (file.empty()) { RPK_ERROR("Invalid path"); status = RPK_INVALID_PATH; return ret; }
-					}
-					std::uint64_t begin = in.tellg();
-					for (auto& file : fileNames) {
-						//exists = false;
-						buffer.resize(2, 0);
-						in.read(&buffer[0], 2);
-						std::uint16_t fileCount = util::convertCharsToUint16(buffer.c_str());
-						for (std::uint16_t i = 0; i < fileCount; i++) {
-							in.get(cbuffer);
-							bool isFile = cbuffer & RPK_TRAIT_IS_FILE;
-							// name length
-							in.get(cbuffer);
-							buffer.resize((std::size_t)(std::uint8_t)cbuffer);
-							in.read(&buffer[0], buffer.length());
-							std::string name = buffer;
-							if (name == file && !isFile) {
-								//exists = true;
-								buffer.resize(8);
-								in.read(&buffer[0], 8);
-								begin = util::convertCharsToUint64(buffer.c_str());
-							}
-							else {
-								if (isFile) {
-									in.seekg(in.tellg() + (std::streampos)16);
-								}
-								else {
-									in.seekg(in.tellg() + (std::streampos)8);
-								}
-							}
-						}
-					}
-					// analyze the directory
-					in.seekg(begin);
-					buffer.resize(2, 0);
-					in.read(&buffer[0], 2);
-					std::uint16_t fileCount = util::convertCharsToUint16(buffer.c_str());
-					for (std::uint16_t i = 0; i < fileCount; i++) {
-						Entry entry;
-						in.get(cbuffer);
-						bool isFile = cbuffer & RPK_TRAIT_IS_FILE;
-						entry.isFile = isFile;
-						// name length
-						in.get(cbuffer);
-						buffer.resize((std::size_t)(std::uint8_t)cbuffer);
-						in.read(&buffer[0], buffer.length());
-						std::string name = buffer;
-						entry.name = name;
-						if (isFile) {
-							// size
-							buffer.resize(8);
-							in.read(&buffer[0], 8);
-							std::uint64_t begin = util::convertCharsToUint64(buffer.c_str());
-							in.read(&buffer[0], 8);
-							entry.length = util::convertCharsToUint64(buffer.c_str()) - begin;
-							entry.formattedLength = util::formatBytes(entry.length);
-						}
-						else {
-							in.seekg(in.tellg() + (std::streampos)8);
-						}
-						ret.entries.push_back(entry);
-					}
-				}
-				}
-			}
-			else {
-				RPK_ERROR("Couln't open input");
-				status = RPK_COULDNT_OPEN_FILE;
-			}
+		switch (options.version) {
+		case RPK_VERSION_1:
+			return createV1Archive(structure, archivePath, options);
+		case RPK_VERSION_2:
+			return createV2Archive(structure, archivePath, options);
+		default:
+			RPK_ERROR("Unsupported file version");
+			return RPK_UNSUPPORTED_VERSION;
 		}
-		return ret;
 	}
-	int package::createArchiveFromStructure(Structure& structure, const std::string& archivePath)
+	int package::createV1Archive(Structure& structure, const std::string& archivePath, const CreateOptions& options)
 	{
+		if (!structure.deletions.empty()) {
+			RPK_ERROR("Deletions need version 2");
+			return RPK_UNSUPPORTED_VERSION;
+		}
+		/* The first copy of a file in header order owns the payload, that is the order writeHeaders uses */
+		std::unordered_set<std::size_t> owned;
+		std::vector<Structure::DirectoryEntry*> pending = { &structure.base };
+		while (!pending.empty()) {
+			Structure::DirectoryEntry* dir = pending.back();
+			pending.pop_back();
+			for (auto& file : dir->files) {
+				file.ownsPayload = file.contentId == RPK_NO_CONTENT_ID || owned.insert(file.contentId).second;
+			}
+			for (auto it = dir->directories.rbegin(); it != dir->directories.rend(); it++) pending.push_back(&*it);
+		}
+		structure.base.calculateLength();
 		if ((structure.base.directories.size() + structure.base.files.size()) > UINT16_MAX) {
-			RPK_ERROR("Base directory contains too many files and directories (over 65535)");
+			RPK_ERROR("Base directory contains too many files and directories for version 1 (over 65535)");
 			return RPK_TOO_MANY_FILES;
 		}
 		if ((structure.base.directories.size() + structure.base.files.size()) == 0) {
@@ -509,51 +1033,197 @@ namespace rvn {
 			return RPK_DIR_IS_EMPTY;
 		}
 
-		std::ofstream out(archivePath, std::ios::binary);
-		if (!out) {
+		platform::File out;
+		if (!out.openWrite(archivePath)) {
 			RPK_ERROR("Couldn't open output file");
 			return RPK_COULDNT_OPEN_FILE;
 		}
-		out << RPK_MAGIC_NUMBER;
+		std::string header = RPK_MAGIC_NUMBER;
+		header.push_back((char)RPK_VERSION_1);
+		if (!out.writeAt(0, header.data(), header.length())) {
+			RPK_ERROR("Couldn't write output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+
+		/* Every header table and payload offset is known up front, so all of them can be written in any order */
+		std::vector<Structure::PayloadJob> jobs;
+		std::unordered_map<std::size_t, std::pair<std::uint64_t, std::uint64_t>> payloads;
+		int status = structure.base.writeHeaders(out, header.length(), jobs, payloads);
+		if (status != RPK_OK) return status;
+		Structure::PayloadWriter writer(out, jobs, true, 0);
+		return writer.run(options.threads);
+	}
+	int package::createV2Archive(Structure& structure, const std::string& archivePath, const CreateOptions& options)
+	{
+		// An archive that only deletes paths of the ones below it is fine
+		if ((structure.base.directories.size() + structure.base.files.size()) == 0 && structure.deletions.empty()) {
+			RPK_ERROR("Base directory is empty");
+			return RPK_DIR_IS_EMPTY;
+		}
+		if (options.alignment & (options.alignment - 1)) {
+			RPK_ERROR("Alignment has to be a power of two");
+			return RPK_INVALID_OPTIONS;
+		}
+		if (options.solidBlockSize > RPK_V2_MAX_SOLID_BLOCK_SIZE) {
+			RPK_ERROR("Solid blocks can't be larger than " + package::util::formatBytes(RPK_V2_MAX_SOLID_BLOCK_SIZE));
+			return RPK_INVALID_OPTIONS;
+		}
 
-		out << (char)RPK_VERSION_1;
+		/* Flatten the tree, every directory comes before its children */
+		struct FlatEntry {
+			format::Record record;
+			Structure::FileEntry* file = nullptr;
+		};
+		std::vector<FlatEntry> flat;
+		struct PendingDirectory {
+			Structure::DirectoryEntry* dir;
+			std::uint32_t index;
+		};
+		std::vector<PendingDirectory> pending = { { &structure.base, RPK_V2_NO_PARENT } };
+		while (!pending.empty()) {
+			PendingDirectory current = pending.back();
+			pending.pop_back();
+			std::string prefix = current.index == RPK_V2_NO_PARENT ? "" : flat[current.index].record.path + "/";
+			for (auto& file : current.dir->files) {
+				FlatEntry entry;
+				entry.record.path = prefix + file.name;
+				entry.record.parent = current.index;
+				entry.record.traits = RPK_TRAIT_IS_FILE;
+				entry.file = &file;
+				flat.push_back(entry);
+			}
+			for (auto& dir : current.dir->directories) {
+				FlatEntry entry;
+				entry.record.path = prefix + dir.name;
+				entry.record.parent = current.index;
+				flat.push_back(entry);
+				pending.push_back({ &dir, (std::uint32_t)(flat.size() - 1) });
+			}
+		}
+		if (flat.size() >= RPK_V2_NO_PARENT - 1) {
+			RPK_ERROR("Archive contains too many files and directories");
+			return RPK_TOO_MANY_FILES;
+		}
+		for (auto& entry : flat) {
+			if (entry.record.path.length() > RPK_V2_MAX_PATH_LENGTH) {
+				RPK_ERROR("Path '" + entry.record.path.substr(0, 64) + "...' is too long");
+				return RPK_INVALID_PATH;
+			}
+		}
+
+		platform::File out;
+		if (!out.openWrite(archivePath)) {
+			RPK_ERROR("Couldn't open output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
+		std::string header = RPK_MAGIC_NUMBER;
+		header.push_back((char)RPK_VERSION_2);
+		if (!out.writeAt(0, header.data(), header.length())) {
+			RPK_ERROR("Couldn't write output file");
+			return RPK_COULDNT_OPEN_FILE;
+		}
 
-		/* Write file count */
-		out.write(util::convertUint16ToChars((std::uint16_t)structure.base.files.size() 
-			+ (std::uint16_t)structure.base.directories.size()).chars, 2);
+		/* Payloads, small files go into the current solid block until it is full */
+		std::vector<Structure::PayloadJob> jobs;
+		// Job of every file entry, copies of the same contents share the job of the first one.
+		// Files in a solid block use the job of the block and know their offset inside it
+		std::vector<std::size_t> entryJobs(flat.size(), SIZE_MAX);
+		std::vector<std::uint32_t> entryBlocks(flat.size(), RPK_V2_NO_BLOCK);
+		std::vector<std::uint64_t> blockOffsets(flat.size(), 0);
+		std::unordered_map<std::size_t, std::size_t> contentOwners;
+		std::deque<Structure::FileEntry> blocks;
+		std::vector<std::size_t> blockJobs;
+		const Compression blockCompression(RPK_CODEC_LZ4, options.compression.codec == RPK_CODEC_LZ4 ? options.compression.level : RPK_COMPRESSION_LEVEL_DEFAULT);
+		// Traced files first, so their payloads and solid blocks end up next to each other
+		std::vector<std::size_t> order;
+		for (std::size_t i = 0; i < flat.size(); i++) {
+			if (flat[i].file) order.push_back(i);
+		}
+		sortByAccess(order, options, [&](std::size_t i) -> const std::string& { return flat[i].record.path; });
+		for (std::size_t i : order) {
+			Structure::FileEntry& file = *flat[i].file;
+			if (file.contentId != RPK_NO_CONTENT_ID) {
+				auto it = contentOwners.find(file.contentId);
+				if (it != contentOwners.end()) {
+					entryJobs[i] = entryJobs[it->second];
+					entryBlocks[i] = entryBlocks[it->second];
+					blockOffsets[i] = blockOffsets[it->second];
+					continue;
+				}
+				contentOwners.emplace(file.contentId, i);
+			}
+			if (file.length > 0 && file.length < options.solidThreshold && file.length <= options.solidBlockSize) {
+				if (blocks.empty() || blocks.back().length + file.length > options.solidBlockSize) {
+					const std::string name = "solid block " + std::to_string(blocks.size());
+					blocks.emplace_back(File(name, std::make_shared<std::string>()), name, blockCompression);
+					Structure::PayloadJob job;
+					job.file = &blocks.back();
+					blockJobs.push_back(jobs.size());
+					jobs.push_back(job);
+				}
+				Structure::FileEntry& block = blocks.back();
+				entryJobs[i] = blockJobs.back();
+				entryBlocks[i] = (std::uint32_t)(blocks.size() - 1);
+				blockOffsets[i] = block.length;
+				block.members.push_back(&file);
+				block.length += file.length;
+				continue;
+			}
+			Structure::PayloadJob job;
+			job.file = flat[i].file;
+			entryJobs[i] = jobs.size();
+			jobs.push_back(job);
+		}
+		Structure::PayloadWriter writer(out, jobs, false, header.length(), options.alignment, options.alignmentThreshold, options.checksums);
+		int status = writer.run(options.threads);
+		if (status != RPK_OK) return status;
+		std::vector<format::Block> blockRecords(blocks.size());
+		for (std::size_t i = 0; i < blocks.size(); i++) {
+			const Structure::PayloadJob& job = jobs[blockJobs[i]];
+			format::Block& block = blockRecords[i];
+			block.begin = job.begin;
+			block.end = job.end;
+			block.codec = job.codec;
+			block.length = blocks[i].length;
+			if (options.checksums) {
+				block.traits = RPK_TRAIT_CHECKSUM;
+				block.checksum = job.checksum;
+			}
+		}
+		for (std::size_t i = 0; i < flat.size(); i++) {
+			if (entryJobs[i] == SIZE_MAX) continue;
+			const Structure::PayloadJob& job = jobs[entryJobs[i]];
+			format::Record& record = flat[i].record;
+			if (entryBlocks[i] != RPK_V2_NO_BLOCK) {
+				record.traits |= RPK_TRAIT_SOLID;
+				record.block = entryBlocks[i];
+				record.begin = blockOffsets[i];
+				record.end = blockOffsets[i] + flat[i].file->length;
+				continue;
+			}
+			record.begin = job.begin;
+			record.end = job.end;
+			if (job.codec != RPK_CODEC_NONE) {
+				record.traits |= RPK_TRAIT_COMPRESSED;
+				record.codec = job.codec;
+				record.length = job.file->length;
+			}
+			if (options.checksums) {
+				record.traits |= RPK_TRAIT_CHECKSUM;
+				record.checksum = job.checksum;
+			}
+		}
 
-		/* Header length calculation */
-		std::uint64_t headerLength = RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH + RPK_V1_FILE_COUNT_LENGTH;
-		for (auto& dir : structure.base.directories) {
-			headerLength += RPK_V1_DIR_HEADER_LENGTH;
-			headerLength += dir.name.length();
-		}
-		for (auto& file : structure.base.files) {
-			headerLength += RPK_V1_FILE_HEADER_LENGTH;
-			headerLength += file.name.length();
-		}
-		/* Write file headers */
-		std::uint64_t currentFileBegin = headerLength;
-		for (auto& file : structure.base.files) {
-			out << (char)RPK_TRAIT_IS_FILE;
-			out << (std::uint8_t)file.name.length();
-			out << file.name.substr(0, 255);
-			out.write(util::convertUint64ToChars(currentFileBegin).chars, 8);
-			currentFileBegin += file.file.getLength();
-			out.write(util::convertUint64ToChars(currentFileBegin).chars, 8);
-		}
-		for (auto& dir : structure.base.directories) {
-			out << (char)0;
-			out << (std::uint8_t)dir.name.length();
-			out << dir.name.substr(0, 255);
-			out.write(util::convertUint64ToChars(currentFileBegin).chars, 8);
-			currentFileBegin += (dir.getLength() + dir.getHeaderLength());
-		}
-		for (auto& file : structure.base.files) {
-			file.writeToOutput(out);
-		}
-		for (auto& dir : structure.base.directories) {
-			dir.writeToOutput(out);
+		/* Central directory and footer */
+		std::vector<format::Record> records;
+		records.reserve(flat.size());
+		for (auto& entry : flat) records.push_back(std::move(entry.record));
+		const std::uint64_t directoryOffset = writer.getEnd();
+		std::string directory = format::buildDirectory(records, options.alignment, options.alignmentThreshold, blockRecords, structure.deletions);
+		directory += format::buildFooter(directoryOffset, directory);
+		if (!out.writeAt(directoryOffset, directory.data(), directory.length())) {
+			RPK_ERROR("Couldn't write output file");
+			return RPK_COULDNT_OPEN_FILE;
 		}
 		return RPK_OK;
 	}
@@ -633,28 +1303,62 @@ namespace rvn {
 	}
 	std::vector<std::string> package::util::convertPath(const std::string& path)
 	{
-		std::size_t position = 0;
 		std::string filePathCopy = path;
-		while (filePathCopy.find('\\') != filePathCopy.npos) {
-			position = filePathCopy.find('\\');
-			filePathCopy = filePathCopy.replace(position, 1, "/");
-		}
+		std::replace(filePathCopy.begin(), filePathCopy.end(), '\\', '/');
 		return util::split(filePathCopy, "/");
 	}
+	std::string package::util::getExtension(const std::string& name)
+	{
+		std::string extension = std::filesystem::path(name).extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+		return extension;
+	}
 	void package::PackageCreator::addFile(const std::string& path, std::shared_ptr<std::string> source)
 	{
-		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), source) });
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), source), std::nullopt });
 	}
-	void package::PackageCreator::addFile(const std::string& path, const File& file)
+	void package::PackageCreator::addFile(const std::string& path, const File& file, const std::optional<Compression>& compression)
 	{
-		entry.push_back({ path, file });
+		entry.push_back({ path, file, compression });
 	}
 	void package::PackageCreator::addFile(const std::string& path, const std::string& harddrivePath)
 	{
-		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), harddrivePath) });
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), harddrivePath), std::nullopt });
+	}
+	void package::PackageCreator::addFile(const std::string& path, std::shared_ptr<std::string> source, const Compression& compression)
+	{
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), source), compression });
+	}
+	void package::PackageCreator::addFile(const std::string& path, const std::string& harddrivePath, const Compression& compression)
+	{
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), harddrivePath), compression });
+	}
+	void package::PackageCreator::setCompression(const std::string& extension, const Compression& compression)
+	{
+		std::string key = extension;
+		if (key.empty() || key[0] != '.') key = "." + key;
+		std::transform(key.begin(), key.end(), key.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+		extensionCompression[key] = compression;
+	}
+	void package::PackageCreator::addFile(const std::string& path, const char* data, std::size_t length, const std::optional<Compression>& compression)
+	{
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), nullptr, data, length), compression });
+	}
+	void package::PackageCreator::addFile(const std::string& path, std::shared_ptr<const void> owner, const char* data, std::size_t length,
+		const std::optional<Compression>& compression)
+	{
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), std::move(owner), data, length), compression });
+	}
+	void package::PackageCreator::addFile(const std::string& path, std::uint64_t length, ReadCallback source, const std::optional<Compression>& compression)
+	{
+		entry.push_back({ path, File(std::filesystem::path(path).filename().string(), std::move(source), length), compression });
 	}
 	void package::PackageCreator::addDirectory(const std::string& path)
 	{
 		entry.push_back({ path });
 	}
+	void package::PackageCreator::addDeletion(const std::string& path)
+	{
+		deletions.push_back(path);
+	}
 }
\ No newline at end of file
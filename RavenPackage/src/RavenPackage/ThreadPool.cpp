@@ -0,0 +1,72 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace rvn {
+	ThreadPool::ThreadPool(std::size_t threadCount)
+	{
+		threadCount = resolveThreadCount(threadCount);
+		_threads.reserve(threadCount);
+		for (std::size_t i = 0; i < threadCount; i++) {
+			_threads.emplace_back([this]() { work(); });
+		}
+	}
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_taskAvailable.notify_all();
+		for (auto& thread : _threads) thread.join();
+	}
+	void ThreadPool::submit(std::function<void()> task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.push_back(std::move(task));
+		}
+		_taskAvailable.notify_one();
+	}
+	void ThreadPool::wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_idle.wait(lock, [this]() { return _tasks.empty() && _running == 0; });
+	}
+	std::size_t ThreadPool::resolveThreadCount(std::size_t threadCount)
+	{
+		if (threadCount == 0) threadCount = std::thread::hardware_concurrency();
+		return threadCount == 0 ? 1 : threadCount;
+	}
+	void ThreadPool::work()
+	{
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_taskAvailable.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+				if (_tasks.empty()) return;
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+				_running++;
+			}
+			task();
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_running--;
+				if (_tasks.empty() && _running == 0) _idle.notify_all();
+			}
+		}
+	}
+	void ThreadPool::run(std::size_t threadCount, std::size_t workCount, const std::function<void()>& worker)
+	{
+		threadCount = std::min(resolveThreadCount(threadCount), std::max<std::size_t>(workCount, 1));
+		if (threadCount <= 1) {
+			worker();
+			return;
+		}
+		ThreadPool pool(threadCount);
+		for (std::size_t i = 0; i < threadCount; i++) pool.submit(worker);
+		pool.wait();
+	}
+}
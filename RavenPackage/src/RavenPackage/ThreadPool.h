@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rvn {
+	// Fixed number of worker threads working off a shared queue
+	class ThreadPool {
+	public:
+		// 0 threads uses one thread per core
+		explicit ThreadPool(std::size_t threadCount = 0);
+		// Finishes all queued tasks before joining the workers
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		void submit(std::function<void()> task);
+		// Blocks until every task submitted so far has finished
+		void wait();
+		std::size_t getThreadCount() const { return _threads.size(); }
+		// Number of threads to use for a requested count, 0 means one per core
+		static std::size_t resolveThreadCount(std::size_t threadCount);
+		// Runs worker on up to threadCount threads at once and waits for all of them, never more threads
+		// than there is work for. A single worker runs on the calling thread
+		static void run(std::size_t threadCount, std::size_t workCount, const std::function<void()>& worker);
+	private:
+		void work();
+
+		std::vector<std::thread> _threads;
+		std::deque<std::function<void()>> _tasks;
+		std::mutex _mutex;
+		std::condition_variable _taskAvailable;
+		std::condition_variable _idle;
+		std::size_t _running = 0;
+		bool _stopping = false;
+	};
+}
@@ -0,0 +1,260 @@
+#include "VirtualFileSystem.h"
+#include "Format.h"
+
+#include <algorithm>
+
+namespace rvn {
+	VirtualFileSystem::VirtualFileSystem()
+	{
+		unmountAll();
+	}
+	int VirtualFileSystem::mount(const std::string& archivePath)
+	{
+		auto reader = std::make_unique<ArchiveReader>();
+		int status = reader->open(archivePath);
+		if (status != RPK_OK) return status;
+		_layers.push_back(std::move(reader));
+		addLayer((std::uint32_t)(_layers.size() - 1));
+		resolveNodes();
+		return RPK_OK;
+	}
+	int VirtualFileSystem::unmount(std::size_t layer)
+	{
+		if (layer >= _layers.size()) {
+			RPK_ERROR("Layer isn't mounted");
+			return RPK_INVALID_OPTIONS;
+		}
+		removeLayer((std::uint32_t)layer);
+		for (auto& node : _nodes) {
+			for (auto& provider : node.providers) {
+				if (provider.layer > layer) provider.layer--;
+			}
+		}
+		_layers.erase(_layers.begin() + layer);
+		resolveNodes();
+		return RPK_OK;
+	}
+	int VirtualFileSystem::remount(std::size_t layer)
+	{
+		if (layer >= _layers.size()) {
+			RPK_ERROR("Layer isn't mounted");
+			return RPK_INVALID_OPTIONS;
+		}
+		auto reader = std::make_unique<ArchiveReader>();
+		int status = reader->open(_layers[layer]->getPath());
+		if (status != RPK_OK) {
+			unmount(layer);
+			return status;
+		}
+		removeLayer((std::uint32_t)layer);
+		_layers[layer] = std::move(reader);
+		addLayer((std::uint32_t)layer);
+		resolveNodes();
+		return RPK_OK;
+	}
+	void VirtualFileSystem::unmountAll()
+	{
+		_layers.clear();
+		_nodes.clear();
+		_index.clear();
+		// Node 0 is the root, it always exists
+		_nodes.emplace_back();
+		_index.emplace("", 0);
+	}
+	std::size_t VirtualFileSystem::resolve(const std::string& filePath) const
+	{
+		std::uint32_t node = find(filePath);
+		return node == UINT32_MAX || node == 0 ? SIZE_MAX : _nodes[node].layer;
+	}
+	bool VirtualFileSystem::exists(const std::string& filePath) const
+	{
+		return find(filePath) != UINT32_MAX;
+	}
+	int VirtualFileSystem::extractFile(const std::string& filePath, const std::string& targetPath) const
+	{
+		const ArchiveReader* reader = findFile(filePath);
+		if (!reader) return RPK_INVALID_PATH;
+		return reader->extractFile(filePath, targetPath);
+	}
+	std::pair<int, std::shared_ptr<std::string>> VirtualFileSystem::extractToString(const std::string& filePath) const
+	{
+		const ArchiveReader* reader = findFile(filePath);
+		if (!reader) return { RPK_INVALID_PATH, nullptr };
+		return reader->extractToString(filePath);
+	}
+	std::pair<int, std::shared_ptr<const std::string>> VirtualFileSystem::getShared(const std::string& filePath) const
+	{
+		const ArchiveReader* reader = findFile(filePath);
+		if (!reader) return { RPK_INVALID_PATH, nullptr };
+		return reader->getShared(filePath);
+	}
+	Entries VirtualFileSystem::getEntriesAt(const std::string& filePath) const
+	{
+		Entries ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || (index != 0 && _layers[_nodes[index].layer]->_entries[_nodes[index].index].isFile())) {
+			RPK_ERROR("Directory doesn't exist in file system");
+			ret.status = RPK_INVALID_PATH;
+			return ret;
+		}
+		const Node& dir = _nodes[index];
+		ret.entries.reserve(dir.childCount);
+		for (std::uint32_t child : dir.children) {
+			if (_nodes[child].layer != RPK_VFS_NO_LAYER) ret.entries.push_back(makeEntry(_nodes[child]));
+		}
+		return ret;
+	}
+	std::pair<int, Entry> VirtualFileSystem::getEntry(const std::string& filePath) const
+	{
+		std::pair<int, Entry> ret;
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX) {
+			RPK_ERROR("Path doesn't exist in file system");
+			ret.first = RPK_INVALID_PATH;
+			return ret;
+		}
+		ret.first = RPK_OK;
+		ret.second = makeEntry(_nodes[index]);
+		return ret;
+	}
+	EntryView VirtualFileSystem::view(const std::string& filePath) const
+	{
+		const ArchiveReader* reader = findFile(filePath);
+		if (!reader) {
+			EntryView ret;
+			ret.status = RPK_INVALID_PATH;
+			return ret;
+		}
+		return reader->view(filePath);
+	}
+	EntryStream VirtualFileSystem::openStream(const std::string& filePath) const
+	{
+		const ArchiveReader* reader = findFile(filePath);
+		// A default stream reports RPK_INVALID_PATH
+		if (!reader) return EntryStream();
+		return reader->openStream(filePath);
+	}
+	std::uint32_t VirtualFileSystem::getNode(const std::string& path)
+	{
+		auto it = _index.find(path);
+		if (it != _index.end()) return it->second;
+		const std::size_t separator = path.find_last_of('/');
+		const std::uint32_t parent = separator == std::string::npos ? 0 : getNode(path.substr(0, separator));
+		return getNode(path, parent);
+	}
+	std::uint32_t VirtualFileSystem::getNode(const std::string& path, std::uint32_t parent)
+	{
+		auto inserted = _index.emplace(path, (std::uint32_t)_nodes.size());
+		if (!inserted.second) return inserted.first->second;
+		_nodes.emplace_back();
+		_nodes.back().parent = parent;
+		_nodes[parent].children.push_back(inserted.first->second);
+		return inserted.first->second;
+	}
+	void VirtualFileSystem::addProvider(std::uint32_t node, Provider provider)
+	{
+		std::vector<Provider>& providers = _nodes[node].providers;
+		// The first entry of a path wins inside an archive, like in ArchiveReader
+		for (auto& existing : providers) {
+			if (existing.layer == provider.layer && existing.index != RPK_VFS_DELETION && provider.index != RPK_VFS_DELETION) return;
+		}
+		auto it = std::upper_bound(providers.begin(), providers.end(), provider.layer, [](std::uint32_t layer, const Provider& other) {
+			return layer < other.layer;
+		});
+		providers.insert(it, provider);
+	}
+	void VirtualFileSystem::addLayer(std::uint32_t layer)
+	{
+		const ArchiveReader& reader = *_layers[layer];
+		// Parents come before their children in the reader too, so their nodes are known
+		std::vector<std::uint32_t> nodes(reader._entries.size(), 0);
+		for (std::uint32_t i = 1; i < reader._entries.size(); i++) {
+			const ArchiveReader::IndexEntry& entry = reader._entries[i];
+			nodes[i] = getNode(reader.getEntryPath(entry), nodes[entry.parent]);
+			addProvider(nodes[i], { layer, i });
+		}
+		for (auto& path : reader.getDeletions()) addProvider(getNode(path), { layer, RPK_VFS_DELETION });
+	}
+	void VirtualFileSystem::removeLayer(std::uint32_t layer)
+	{
+		for (auto& node : _nodes) {
+			node.providers.erase(std::remove_if(node.providers.begin(), node.providers.end(), [layer](const Provider& provider) {
+				return provider.layer == layer;
+			}), node.providers.end());
+		}
+	}
+	void VirtualFileSystem::resolveNodes()
+	{
+		// Lowest layer that isn't deleted at or above a node, parents are resolved first
+		std::vector<std::uint32_t> lowest(_nodes.size(), 0);
+		for (std::size_t id = 0; id < _nodes.size(); id++) {
+			Node& node = _nodes[id];
+			node.layer = RPK_VFS_NO_LAYER;
+			node.fileCount = 0;
+			node.length = 0;
+			node.childCount = 0;
+			if (id == 0) continue;
+			lowest[id] = lowest[node.parent];
+			const Provider* top = nullptr;
+			for (auto& provider : node.providers) {
+				if (provider.index == RPK_VFS_DELETION) lowest[id] = std::max(lowest[id], provider.layer);
+				else top = &provider;
+			}
+			// A deletion keeps the entries of its own layer
+			if (!top || top->layer < lowest[id]) continue;
+			const Node& parent = _nodes[node.parent];
+			if (node.parent != 0 && (parent.layer == RPK_VFS_NO_LAYER || _layers[parent.layer]->_entries[parent.index].isFile())) continue;
+			node.layer = top->layer;
+			node.index = top->index;
+		}
+		// Children have higher ids, so going backwards adds every directory up before its parent
+		for (std::size_t id = _nodes.size() - 1; id > 0; id--) {
+			const Node& node = _nodes[id];
+			if (node.layer == RPK_VFS_NO_LAYER) continue;
+			Node& parent = _nodes[node.parent];
+			const ArchiveReader::IndexEntry& entry = _layers[node.layer]->_entries[node.index];
+			parent.childCount++;
+			if (entry.isFile()) {
+				parent.fileCount++;
+				parent.length += entry.length;
+			}
+			else {
+				parent.fileCount += node.fileCount;
+				parent.length += node.length;
+			}
+		}
+	}
+	std::uint32_t VirtualFileSystem::find(const std::string& filePath) const
+	{
+		metrics::ScopedTimer timer(metrics::Timer::Lookup);
+		auto it = _index.find(format::normalizePath(filePath));
+		if (it == _index.end()) return UINT32_MAX;
+		if (it->second != 0 && _nodes[it->second].layer == RPK_VFS_NO_LAYER) return UINT32_MAX;
+		return it->second;
+	}
+	const ArchiveReader* VirtualFileSystem::findFile(const std::string& filePath) const
+	{
+		std::uint32_t index = find(filePath);
+		if (index == UINT32_MAX || index == 0 || !_layers[_nodes[index].layer]->_entries[_nodes[index].index].isFile()) {
+			RPK_ERROR("File doesn't exist in file system");
+			return nullptr;
+		}
+		return _layers[_nodes[index].layer].get();
+	}
+	Entry VirtualFileSystem::makeEntry(const Node& node) const
+	{
+		Entry entry;
+		if (node.layer != RPK_VFS_NO_LAYER) {
+			entry = _layers[node.layer]->makeEntry(_layers[node.layer]->_entries[node.index]);
+			if (entry.isFile) return entry;
+		}
+		else entry.isFile = false;
+		// Directories of several layers are merged, so their totals are too
+		entry.length = (std::size_t)node.length;
+		entry.formattedLength = package::util::formatBytes(entry.length);
+		entry.childCount = node.childCount;
+		entry.fileCount = (std::size_t)node.fileCount;
+		entry.hasSubFiles = node.childCount > 0;
+		return entry;
+	}
+}
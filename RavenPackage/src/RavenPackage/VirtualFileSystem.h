@@ -0,0 +1,98 @@
+#pragma once
+
+#include "RavenPackage.h"
+#include "ArchiveReader.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Provider::index of a deletion
+#define RPK_VFS_DELETION UINT32_MAX
+// Node::layer of a path that doesn't resolve
+#define RPK_VFS_NO_LAYER UINT32_MAX
+
+namespace rvn {
+	// Several archives mounted on top of each other as one tree, e.g. a game with its patches and mods.
+	// A path is served by the highest layer that has it, a layer can also hide paths of the layers
+	// below it (PackageCreator::addDeletion). All layers share one merged index, so a lookup costs
+	// the same no matter how many archives are mounted.
+	// Const member functions can be called from several threads at once, mounting can't run alongside them
+	class VirtualFileSystem {
+	public:
+		VirtualFileSystem();
+		VirtualFileSystem(const VirtualFileSystem&) = delete;
+		VirtualFileSystem& operator=(const VirtualFileSystem&) = delete;
+
+		// Mounts an archive above all others, it becomes layer getLayerCount() - 1.
+		// Returns one of the RPK_* codes, nothing changes if the archive can't be opened
+		int mount(const std::string& archivePath);
+		// Removes a layer, the layers above it move down by one
+		int unmount(std::size_t layer);
+		// Opens the archive of a layer again, e.g. after it was updated. Only the paths of
+		// this layer are indexed again, on failure the layer is unmounted
+		int remount(std::size_t layer);
+		void unmountAll();
+		std::size_t getLayerCount() const { return _layers.size(); }
+		const ArchiveReader& getLayer(std::size_t layer) const { return *_layers[layer]; }
+		// Layer that serves a path, SIZE_MAX if the path doesn't exist. "" is the root and has no layer
+		std::size_t resolve(const std::string& filePath) const;
+
+		// Same as the ArchiveReader functions, for the merged tree
+		bool exists(const std::string& filePath) const;
+		int extractFile(const std::string& filePath, const std::string& targetPath) const;
+		std::pair<int, std::shared_ptr<std::string>> extractToString(const std::string& filePath) const;
+		std::pair<int, std::shared_ptr<const std::string>> getShared(const std::string& filePath) const;
+		// Directories list the children of all layers, their totals count the visible files only
+		Entries getEntriesAt(const std::string& filePath) const;
+		std::pair<int, Entry> getEntry(const std::string& filePath) const;
+		EntryView view(const std::string& filePath) const;
+		EntryStream openStream(const std::string& filePath) const;
+	private:
+		// An entry of a layer at a path, index RPK_VFS_DELETION marks a deletion
+		struct Provider {
+			std::uint32_t layer;
+			std::uint32_t index;
+		};
+		// A path of any layer. Nodes are never removed, paths no layer has anymore just stop resolving
+		struct Node {
+			// Parents always have a lower id than their children
+			std::uint32_t parent = 0;
+			std::vector<std::uint32_t> children;
+			// Lowest layer first
+			std::vector<Provider> providers;
+			// Provider that serves the path, layer is RPK_VFS_NO_LAYER if it is hidden or gone
+			std::uint32_t layer = RPK_VFS_NO_LAYER;
+			std::uint32_t index = 0;
+			// Merged totals of a directory
+			std::uint64_t fileCount = 0;
+			std::uint64_t length = 0;
+			std::uint32_t childCount = 0;
+		};
+
+		// Index of the node at a normalized path, created with its parents if there is none yet
+		std::uint32_t getNode(const std::string& path);
+		std::uint32_t getNode(const std::string& path, std::uint32_t parent);
+		void addProvider(std::uint32_t node, Provider provider);
+		// Adds the entries and deletions of a layer to the nodes
+		void addLayer(std::uint32_t layer);
+		void removeLayer(std::uint32_t layer);
+		// Decides which provider serves each node and adds up the directory totals,
+		// only looks at the providers and not at any paths
+		void resolveNodes();
+		// Visible node at the path or UINT32_MAX
+		std::uint32_t find(const std::string& filePath) const;
+		// Layer that serves a file, nullptr if there is none. Reads go through the path again,
+		// which costs one more lookup in that layer only
+		const ArchiveReader* findFile(const std::string& filePath) const;
+		Entry makeEntry(const Node& node) const;
+
+		// unique_ptr keeps the readers in place while layers are added and removed
+		std::vector<std::unique_ptr<ArchiveReader>> _layers;
+		std::vector<Node> _nodes;
+		std::unordered_map<std::string, std::uint32_t> _index;
+	};
+}
@@ -0,0 +1,333 @@
+#include <RavenPackage/RavenPackage.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+// Benchmarks creating, extracting and listing archives of synthetic trees and prints JSON
+namespace bench {
+	namespace fs = std::filesystem;
+	using Clock = std::chrono::steady_clock;
+
+	struct Options {
+		fs::path workDir;
+		std::string outputPath;
+		// Smaller trees, for checking the benchmark itself
+		bool quick = false;
+		std::size_t samples = 1000;
+		std::size_t threads = 1;
+		bool keep = false;
+	};
+	// A synthetic tree, files are spread over dirCount directories nested depth levels deep
+	struct Scenario {
+		std::string name;
+		std::size_t fileCount;
+		std::size_t minSize;
+		std::size_t maxSize;
+		std::size_t dirCount;
+		std::size_t depth;
+	};
+	struct Stats {
+		std::string operation;
+		std::string cache;
+		std::size_t count = 0;
+		std::size_t failures = 0;
+		std::uint64_t bytes = 0;
+		double seconds = 0;
+		// Microseconds
+		std::vector<double> latencies;
+	};
+
+	std::vector<Scenario> getScenarios(bool quick)
+	{
+		if (quick) {
+			return {
+				{ "tiny", 2000, 16, 4096, 20, 1 },
+				{ "large", 2, 64ull << 20, 64ull << 20, 1, 1 },
+				{ "deep", 256, 16, 4096, 8, 32 },
+				{ "wide", 5000, 16, 1024, 1, 1 }
+			};
+		}
+		return {
+			{ "tiny", 100000, 16, 4096, 1000, 2 },
+			{ "large", 3, 2ull << 30, 3ull << 30, 1, 1 },
+			{ "deep", 4096, 16, 4096, 64, 128 },
+			{ "wide", 60000, 16, 1024, 1, 1 }
+		};
+	}
+	// Fills a buffer with data that compresses somewhat, like most real assets
+	void fillData(std::mt19937_64& rng, char* dst, std::size_t length)
+	{
+		static const char words[] = "raven package asset texture mesh sound level script ";
+		for (std::size_t i = 0; i < length; i++) {
+			dst[i] = (rng() & 3) == 0 ? (char)rng() : words[i % (sizeof(words) - 1)];
+		}
+	}
+	std::string getDirPath(const Scenario& scenario, std::size_t dir)
+	{
+		// Every directory is nested depth levels deep, directory 0 of every level is shared
+		std::string path;
+		for (std::size_t level = 0; level < scenario.depth; level++) {
+			if (!path.empty()) path += "/";
+			path += "d" + std::to_string(level + 1 == scenario.depth ? dir : 0) + "_" + std::to_string(level);
+		}
+		return path;
+	}
+	bool generateTree(const Scenario& scenario, const fs::path& root)
+	{
+		const fs::path marker = root.string() + ".complete";
+		if (fs::exists(marker) && fs::exists(root)) return true;
+		fs::remove_all(root);
+		std::mt19937_64 rng(scenario.fileCount * 31 + scenario.depth);
+		std::string buffer(1 << 20, 0x00);
+		fillData(rng, &buffer[0], buffer.length());
+		for (std::size_t i = 0; i < scenario.fileCount; i++) {
+			const fs::path dir = root / getDirPath(scenario, i % scenario.dirCount);
+			if (i < scenario.dirCount) fs::create_directories(dir);
+			std::size_t length = scenario.minSize + (std::size_t)(rng() % (scenario.maxSize - scenario.minSize + 1));
+			std::ofstream out(dir / ("f" + std::to_string(i) + ".bin"), std::ios::binary);
+			for (std::size_t done = 0; done < length;) {
+				std::size_t count = std::min(length - done, buffer.length());
+				// Large files get fresh data per block, small ones start at a random offset,
+				// so files don't repeat each other
+				if (length > buffer.length()) fillData(rng, &buffer[0], count);
+				out.write(buffer.data() + rng() % (buffer.length() - count + 1), count);
+				done += count;
+			}
+			if (!out) {
+				std::cerr << "Couldn't write " << (dir / ("f" + std::to_string(i) + ".bin")).string() << std::endl;
+				return false;
+			}
+		}
+		std::ofstream(marker) << "ok";
+		return true;
+	}
+	// Evicts one file from the page cache, returns whether that worked
+	bool evictFile(const fs::path& path)
+	{
+#ifndef _WIN32
+		int fd = ::open(path.string().c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		int result = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+		return result == 0;
+#else
+		return false;
+#endif
+	}
+	// Drops the whole page cache where permitted, otherwise just the file. Returns which method worked
+	std::string dropCache(const fs::path& path)
+	{
+#ifndef _WIN32
+		::sync();
+		{
+			std::ofstream dropCaches("/proc/sys/vm/drop_caches");
+			if (dropCaches && (dropCaches << "1").flush()) return "drop_caches";
+		}
+#endif
+		return evictFile(path) ? "fadvise" : "none";
+	}
+	double getMicroseconds(Clock::time_point begin, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::micro>(end - begin).count();
+	}
+	double getPercentile(std::vector<double> values, double percentile)
+	{
+		if (values.empty()) return 0;
+		std::sort(values.begin(), values.end());
+		std::size_t index = (std::size_t)(percentile * (values.size() - 1) + 0.5);
+		return values[std::min(index, values.size() - 1)];
+	}
+	// Every n-th entry so samples are spread over the whole archive
+	std::vector<std::string> pickSamples(const std::vector<std::string>& paths, std::size_t samples)
+	{
+		std::vector<std::string> ret;
+		std::size_t step = std::max<std::size_t>(paths.size() / std::max<std::size_t>(samples, 1), 1);
+		for (std::size_t i = 0; i < paths.size() && ret.size() < samples; i += step) ret.push_back(paths[i]);
+		return ret;
+	}
+	void listTree(const fs::path& root, std::vector<std::string>& files, std::vector<std::string>& dirs)
+	{
+		dirs.push_back("");
+		for (auto& entry : fs::recursive_directory_iterator(root)) {
+			std::string path = fs::relative(entry.path(), root).generic_string();
+			if (entry.is_directory()) dirs.push_back(path);
+			else files.push_back(path);
+		}
+		std::sort(files.begin(), files.end());
+		std::sort(dirs.begin(), dirs.end());
+	}
+
+	// Without checksums payloads are copied inside the kernel where possible, with them they go through a buffer
+	Stats runCreate(const fs::path& root, const fs::path& archive, const Options& options, std::uint64_t treeBytes, bool checksums)
+	{
+		Stats stats;
+		stats.operation = checksums ? "createArchiveFromDir" : "createArchiveFromDirNoChecksums";
+		stats.cache = dropCache(root);
+		rvn::CreateOptions createOptions;
+		createOptions.threads = options.threads;
+		createOptions.checksums = checksums;
+		auto begin = Clock::now();
+		int status = rvn::package::createArchiveFromDir(root.string(), archive.string(), createOptions, true);
+		auto end = Clock::now();
+		stats.count = 1;
+		stats.failures = status == RPK_OK ? 0 : 1;
+		stats.bytes = treeBytes;
+		stats.latencies.push_back(getMicroseconds(begin, end));
+		stats.seconds = stats.latencies.back() / 1e6;
+		return stats;
+	}
+	Stats runExtractFile(const fs::path& archive, const std::vector<std::string>& samples, const fs::path& target, bool cold)
+	{
+		Stats stats;
+		stats.operation = "extractFile";
+		stats.cache = cold ? dropCache(archive) : "warm";
+		for (std::size_t i = 0; i < samples.size(); i++) {
+			const std::string targetPath = (target / ("x" + std::to_string(i))).string();
+			// Only the archive is evicted per sample, dropping the whole cache every time would take minutes
+			if (cold) evictFile(archive);
+			auto begin = Clock::now();
+			int status = rvn::package::extractFile(archive.string(), samples[i], targetPath);
+			auto end = Clock::now();
+			stats.latencies.push_back(getMicroseconds(begin, end));
+			stats.count++;
+			if (status != RPK_OK) stats.failures++;
+			std::error_code error;
+			std::uintmax_t length = fs::file_size(targetPath, error);
+			if (!error) stats.bytes += length;
+			fs::remove(targetPath, error);
+		}
+		for (double latency : stats.latencies) stats.seconds += latency / 1e6;
+		return stats;
+	}
+	Stats runExtractToString(const fs::path& archive, const std::vector<std::string>& samples, bool cold)
+	{
+		Stats stats;
+		stats.operation = "extractToString";
+		stats.cache = cold ? dropCache(archive) : "warm";
+		for (auto& sample : samples) {
+			if (cold) evictFile(archive);
+			auto begin = Clock::now();
+			auto result = rvn::package::extractToString(archive.string(), sample);
+			auto end = Clock::now();
+			stats.latencies.push_back(getMicroseconds(begin, end));
+			stats.count++;
+			if (result.first != RPK_OK) stats.failures++;
+			else stats.bytes += result.second->length();
+		}
+		for (double latency : stats.latencies) stats.seconds += latency / 1e6;
+		return stats;
+	}
+	Stats runGetEntriesAt(const fs::path& archive, const std::vector<std::string>& samples, bool cold)
+	{
+		Stats stats;
+		stats.operation = "getEntriesAt";
+		stats.cache = cold ? dropCache(archive) : "warm";
+		for (auto& sample : samples) {
+			if (cold) evictFile(archive);
+			auto begin = Clock::now();
+			auto result = rvn::package::getEntriesAt(archive.string(), sample);
+			auto end = Clock::now();
+			stats.latencies.push_back(getMicroseconds(begin, end));
+			stats.count++;
+			if (result.status != RPK_OK) stats.failures++;
+		}
+		for (double latency : stats.latencies) stats.seconds += latency / 1e6;
+		return stats;
+	}
+
+	void writeStats(std::ostream& out, const Stats& stats)
+	{
+		out << "{\"operation\":\"" << stats.operation << "\",\"cache\":\"" << stats.cache << "\""
+			<< ",\"count\":" << stats.count << ",\"failures\":" << stats.failures
+			<< ",\"bytes\":" << stats.bytes << ",\"seconds\":" << stats.seconds
+			<< ",\"opsPerSecond\":" << (stats.seconds > 0 ? stats.count / stats.seconds : 0)
+			<< ",\"bytesPerSecond\":" << (stats.seconds > 0 ? stats.bytes / stats.seconds : 0)
+			<< ",\"p50Us\":" << getPercentile(stats.latencies, 0.5)
+			<< ",\"p99Us\":" << getPercentile(stats.latencies, 0.99) << "}";
+	}
+	bool parseOptions(int argc, char** argv, Options& options)
+	{
+		for (int i = 1; i < argc; i++) {
+			if (!strcmp(argv[i], "-quick")) options.quick = true;
+			else if (!strcmp(argv[i], "-keep")) options.keep = true;
+			else if (!strcmp(argv[i], "-output") && i + 1 < argc) options.outputPath = argv[++i];
+			else if (!strcmp(argv[i], "-samples") && i + 1 < argc) options.samples = std::stoul(argv[++i]);
+			else if (!strcmp(argv[i], "-threads") && i + 1 < argc) options.threads = std::stoul(argv[++i]);
+			else if (argv[i][0] != '-' && options.workDir.empty()) options.workDir = argv[i];
+			else return false;
+		}
+		return !options.workDir.empty();
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace bench;
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		std::cout << "Usage: ravenpackagebenchmark [work dir] [-quick] [-keep] [-output file.json] [-samples n] [-threads n]" << std::endl;
+		return 64;
+	}
+	fs::create_directories(options.workDir);
+	std::ostringstream json;
+	json << "{\"quick\":" << (options.quick ? "true" : "false") << ",\"threads\":" << options.threads
+		<< ",\"samples\":" << options.samples << ",\"scenarios\":[";
+	bool firstScenario = true;
+	for (auto& scenario : getScenarios(options.quick)) {
+		std::cerr << "Scenario " << scenario.name << std::endl;
+		const fs::path root = options.workDir / ("tree_" + scenario.name + (options.quick ? "_quick" : ""));
+		const fs::path archive = options.workDir / (scenario.name + ".rpk");
+		const fs::path target = options.workDir / "extract";
+		if (!generateTree(scenario, root)) return 1;
+		fs::create_directories(target);
+
+		std::vector<std::string> files, dirs;
+		listTree(root, files, dirs);
+		std::uint64_t treeBytes = 0;
+		for (auto& file : files) treeBytes += fs::file_size(root / file);
+		const std::vector<std::string> fileSamples = pickSamples(files, options.samples);
+		const std::vector<std::string> dirSamples = pickSamples(dirs, options.samples);
+
+		std::vector<Stats> results;
+		results.push_back(runCreate(root, archive, options, treeBytes, false));
+		// The archive with checksums is the one the extraction runs read
+		results.push_back(runCreate(root, archive, options, treeBytes, true));
+		for (bool cold : { true, false }) {
+			results.push_back(runExtractFile(archive, fileSamples, target, cold));
+			results.push_back(runExtractToString(archive, fileSamples, cold));
+			results.push_back(runGetEntriesAt(archive, dirSamples, cold));
+		}
+
+		json << (firstScenario ? "" : ",") << "{\"name\":\"" << scenario.name << "\",\"files\":" << files.size()
+			<< ",\"directories\":" << dirs.size() << ",\"treeBytes\":" << treeBytes
+			<< ",\"archiveBytes\":" << fs::file_size(archive) << ",\"results\":[";
+		for (std::size_t i = 0; i < results.size(); i++) {
+			if (i > 0) json << ",";
+			writeStats(json, results[i]);
+		}
+		json << "]}";
+		firstScenario = false;
+		fs::remove(archive);
+		if (!options.keep) {
+			fs::remove_all(root);
+			fs::remove(root.string() + ".complete");
+		}
+	}
+	json << "]}";
+	if (options.outputPath.empty()) {
+		std::cout << json.str() << std::endl;
+	}
+	else {
+		std::ofstream(options.outputPath) << json.str() << std::endl;
+	}
+	return 0;
+}
@@ -1,8 +1,11 @@
 #include <RavenPackage/RavenPackage.h>
+#include <RavenPackage/ArchiveReader.h>
+
+#include <cstring>
 
 int main(int argc, char** argv) {
 	if (argc > 5) {
-		std::cout << "Usage: ravenpackageexecutable [mode:-archive/-extract/-extractto] [dir/archive/archive] [archive/file path/file path] [-/-/output]" << std::endl;
+		std::cout << "Usage: ravenpackageexecutable [mode:-archive/-extract/-extractto/-update/-compact/-verify/-archivetrace/-find] [dir/archive/archive/archive/archive/archive/dir/archive] [archive/file path/file path/dir/-/-/archive/pattern] [-/-/output/-/-/-/access trace/-]" << std::endl;
 		exit(64);
 	}
 	else if (argc == 4) {
@@ -12,16 +15,50 @@ int main(int argc, char** argv) {
 		else if (!strcmp(argv[1], "-extract")) {
 			rvn::package::extractFile(argv[2], argv[3]);
 		}
+		else if (!strcmp(argv[1], "-update")) {
+			rvn::package::updateArchiveFromDir(argv[2], argv[3]);
+		}
+		else if (!strcmp(argv[1], "-find")) {
+			// Glob like "materials/**/*.shader"
+			rvn::ArchiveReader reader;
+			int status = reader.open(argv[2]);
+			if (status != RPK_OK) {
+				std::cout << "Couldn't open archive (" << status << ")" << std::endl;
+				exit(1);
+			}
+			for (auto& match : reader.query(argv[3])) std::cout << (match.isFile ? "FILE\t" : "DIR \t") << match.path << std::endl;
+		}
 		else {
-			std::cout << "Invalid mode. Use -archive." << std::endl;
+			std::cout << "Invalid mode. Use -archive/-extract/-update/-find." << std::endl;
+		}
+	}
+	else if (argc == 3 && !strcmp(argv[1], "-compact")) {
+		rvn::package::compactArchive(argv[2]);
+	}
+	else if (argc == 3 && !strcmp(argv[1], "-verify")) {
+		rvn::ArchiveReader reader;
+		int status = reader.open(argv[2]);
+		if (status != RPK_OK) {
+			std::cout << "Couldn't open archive (" << status << ")" << std::endl;
+			exit(1);
 		}
+		// Checks the payloads on all cores
+		std::vector<rvn::ExtractResult> failed = reader.verify(0);
+		for (auto& result : failed) std::cout << "FAILED " << result.path << " (" << result.status << ")" << std::endl;
+		std::cout << reader.getEntryCount() << " entries checked, " << failed.size() << " failed" << std::endl;
+		exit(failed.empty() ? 0 : 1);
 	}
 	else if (argc == 5) {
 		if (!strcmp(argv[1], "-extractto")) {
 			rvn::package::extractFile(argv[2], argv[3], argv[4]);
 		}
+		else if (!strcmp(argv[1], "-archivetrace")) {
+			// Lays the payloads out in the order of a recorded access trace
+			rvn::CreateOptions options;
+			if (rvn::package::readAccessTrace(argv[4], options.accessOrder) == RPK_OK) rvn::package::createArchiveFromDir(argv[2], argv[3], options);
+		}
 		else {
-			std::cout << "Invalid mode. Use -archive/-extract/-extractto." << std::endl;
+			std::cout << "Invalid mode. Use -extractto/-archivetrace." << std::endl;
 		}
 	}
 	else {
@@ -68,14 +105,23 @@ int main(int argc, char** argv) {
 				std::cout << "Enter archive path > ";
 				std::string archivePath;
 				std::getline(std::cin, archivePath);
+				// Opened once, changing directories only looks at the index in memory
+				rvn::ArchiveReader reader;
+				int status = reader.open(archivePath);
+				if (status != RPK_OK) {
+					std::cout << "Error code: " << status << std::endl;
+					continue;
+				}
 				std::string path = "";
 				for (;;) {
-					auto entries = rvn::package::getEntriesAt(archivePath, path);
+					auto entries = reader.getEntriesAt(path);
 					if (entries.status != RPK_OK) {
 						std::cout << "Error code: " << entries.status << std::endl;
 						break;
 					}
-					std::cout << std::endl << "Files in archive " << archivePath << path << std::endl;
+					auto current = reader.getEntry(path);
+					std::cout << std::endl << "Files in archive " << archivePath << "/" << path << " (" << current.second.fileCount << " files, "
+						<< current.second.formattedLength << ")" << std::endl;
 					for (auto& entry : entries.entries) {
 						if (entry.isFile) {
 							std::cout << "FILE";
@@ -84,9 +130,10 @@ int main(int argc, char** argv) {
 						}
 						else {
 							std::cout << "DIR ";
-							std::cout << "\t" << entry.name << std::endl;
+							std::cout << "\t" << entry.formattedLength << "\t";
+							std::cout << entry.name << " (" << entry.fileCount << " files)" << std::endl;
 							if (entry.hasSubFiles) {
-								std::cout << "    \t" << (char)192 << "..." << std::endl;
+								std::cout << "    \t\t" << (char)192 << "..." << std::endl;
 							}
 						}
 					}
@@ -102,12 +149,12 @@ int main(int argc, char** argv) {
 							}
 						}
 						if (exists) {
-							path = path + "/" + in;
-							exists = true;
+							path = path.empty() ? in : path + "/" + in;
 						}
 						else if (in == "..") {
-							if (path.find('/') != path.npos) {
-								path = path.substr(path.find_last_of('/'), 0);
+							if (!path.empty()) {
+								const std::size_t separator = path.find_last_of('/');
+								path = separator == path.npos ? "" : path.substr(0, separator);
 								exists = true;
 							}
 						}
@@ -0,0 +1,354 @@
+#include <RavenPackage/RavenPackage.h>
+#include <RavenPackage/ArchiveReader.h>
+#include <RavenPackage/ArchiveWriter.h>
+#include <RavenPackage/Hash.h>
+#include <RavenPackage/PathQuery.h>
+#include <RavenPackage/Platform.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+// Regression tests, every test works in its own directory below the work dir. Exits with the number of failures
+namespace tests {
+	namespace fs = std::filesystem;
+
+	struct Test {
+		const char* name;
+		std::function<bool(const fs::path&)> run;
+	};
+
+	#define CHECK(condition) do { if (!(condition)) { std::cerr << "  " << __FILE__ << ":" << __LINE__ << ": " << #condition << std::endl; return false; } } while (0)
+
+	// Flips one byte of a file
+	bool corrupt(const fs::path& path, std::uint64_t offset)
+	{
+		std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+		char byte;
+		file.seekg((std::streamoff)offset);
+		if (!file.get(byte)) return false;
+		file.seekp((std::streamoff)offset);
+		file.put((char)(byte ^ 0x5a));
+		return (bool)file;
+	}
+	// Payloads of version 2 archives start right after the magic number and the version
+	std::uint64_t getFirstPayload()
+	{
+		return RPK_MAGIC_NUMBER_LENGTH + RPK_VERSION_LENGTH;
+	}
+
+	// Whole contents of a file, empty if it can't be read
+	std::string readFile(const fs::path& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), {});
+	}
+	// Whether a temporary file was left behind anywhere below dir
+	bool hasTempFiles(const fs::path& dir)
+	{
+		for (auto& item : fs::recursive_directory_iterator(dir)) {
+			if (item.path().extension() == ".tmp") return true;
+		}
+		return false;
+	}
+
+	// Replaces the first occurrence of from in a file with to, which has the same length
+	bool patch(const fs::path& path, const std::string& from, const std::string& to)
+	{
+		std::string data;
+		{
+			std::ifstream in(path, std::ios::binary);
+			data.assign(std::istreambuf_iterator<char>(in), {});
+		}
+		const std::size_t pos = data.find(from);
+		if (pos == std::string::npos || from.length() != to.length()) return false;
+		data.replace(pos, to.length(), to);
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << data;
+		return true;
+	}
+	// Recomputes the central directory checksum of a version 2 archive after it was patched
+	bool resealDirectory(const fs::path& path)
+	{
+		std::string data;
+		{
+			std::ifstream in(path, std::ios::binary);
+			data.assign(std::istreambuf_iterator<char>(in), {});
+		}
+		const std::size_t footer = data.length() - RPK_V2_FOOTER_LENGTH;
+		std::uint64_t offset = 0;
+		for (int i = 7; i >= 0; i--) offset = (offset << 8) | (std::uint8_t)data[footer + i];
+		const std::uint64_t checksum = RPK_V2_FOOTER_HAS_CHECKSUM | rvn::crc32c(0, data.data() + offset, footer - (std::size_t)offset);
+		for (int i = 0; i < 8; i++) data[footer + 16 + i] = (char)(checksum >> (i * 8));
+		std::ofstream(path, std::ios::binary | std::ios::trunc) << data;
+		return true;
+	}
+
+	bool pathsStayInTarget(const fs::path& dir)
+	{
+		const fs::path target = dir / "work" / "out";
+		for (const char* path : { "../escaped.txt", "a/../../escaped.txt", "./escaped.txt", "a/./b", "C:/escaped.txt", "a/C:escaped.txt" }) {
+			rvn::package::PackageCreator creator;
+			creator.addFile(path, std::make_shared<std::string>("x"));
+			CHECK(rvn::package::createArchive(creator, (dir / "bad.rpk").string(), true) == RPK_INVALID_PATH);
+			rvn::package::PackageCreator deletion;
+			deletion.addDeletion(path);
+			CHECK(rvn::package::createArchive(deletion, (dir / "bad.rpk").string(), true) == RPK_INVALID_PATH);
+			std::vector<char> streamed;
+			rvn::ArchiveWriter writer(streamed);
+			CHECK(writer.addFile(path, "x", 1) == RPK_INVALID_PATH);
+			CHECK(writer.addDeletion(path) == RPK_INVALID_PATH);
+		}
+		// Leading separators are dropped, the path stays relative
+		{
+			rvn::package::PackageCreator creator;
+			creator.addFile("/rooted.txt", std::make_shared<std::string>("x"));
+			CHECK(rvn::package::createArchive(creator, (dir / "rooted.rpk").string(), true) == RPK_OK);
+			rvn::ArchiveReader reader;
+			CHECK(reader.open((dir / "rooted.rpk").string()) == RPK_OK);
+			std::vector<rvn::ExtractResult> results = reader.extractDirectory("", target.string());
+			CHECK(results.size() == 1 && results[0].status == RPK_OK && fs::exists(target / "rooted.txt"));
+		}
+
+		// Archives written by something else: the same length path is patched in, the reader has to refuse them
+		for (std::uint8_t version : { RPK_VERSION_1, RPK_VERSION_2 }) {
+			const fs::path archive = dir / ("crafted" + std::to_string(version) + ".rpk");
+			rvn::package::PackageCreator creator;
+			creator.addFile("qq/escaped.txt", std::make_shared<std::string>("x"));
+			rvn::CreateOptions options;
+			options.version = version;
+			CHECK(rvn::package::createArchive(creator, archive.string(), options, true) == RPK_OK);
+			if (version == RPK_VERSION_1) {
+				// Directory name with its length byte
+				CHECK(patch(archive, std::string("\x02qq", 3), std::string("\x02..", 3)));
+			}
+			else {
+				CHECK(patch(archive, "qq/escaped.txt", "../escaped.txt"));
+				CHECK(resealDirectory(archive));
+			}
+			rvn::ArchiveReader reader;
+			CHECK(reader.open(archive.string()) == RPK_INVALID_PATH);
+			CHECK(rvn::package::extractFile(archive.string(), "../escaped.txt", (target / "x").string()) != RPK_OK);
+		}
+		CHECK(!fs::exists(dir / "work" / "escaped.txt"));
+		CHECK(!fs::exists(dir / "escaped.txt"));
+		return true;
+	}
+
+	bool compactKeepsOtherFiles(const fs::path& dir)
+	{
+		const fs::path archive = dir / "data.rpk";
+		rvn::package::PackageCreator creator;
+		creator.addFile("a.txt", std::make_shared<std::string>("old"));
+		CHECK(rvn::package::createArchive(creator, archive.string(), true) == RPK_OK);
+		rvn::package::PackageCreator changes;
+		changes.addFile("a.txt", std::make_shared<std::string>("new"));
+		CHECK(rvn::package::updateArchive(archive.string(), changes) == RPK_OK);
+		// The name the temporary file used to have
+		std::ofstream(archive.string() + ".compact", std::ios::binary) << "mine";
+		CHECK(rvn::package::compactArchive(archive.string()) == RPK_OK);
+		CHECK(readFile(archive.string() + ".compact") == "mine");
+		CHECK(!hasTempFiles(dir));
+		auto result = rvn::package::extractToString(archive.string(), "a.txt");
+		CHECK(result.first == RPK_OK && *result.second == "new");
+		return true;
+	}
+
+	bool compressedLayout(const fs::path& dir)
+	{
+		// Larger than what a job buffers before its turn, so later jobs have to wait and stream
+		rvn::package::PackageCreator creator;
+		std::vector<std::shared_ptr<std::string>> files;
+		for (std::size_t i = 0; i < 6; i++) {
+			auto data = std::make_shared<std::string>();
+			for (std::size_t line = 0; data->length() < (20 + i) * RPK_COMPRESSION_CHUNK_SIZE + i; line++) data->append(std::to_string(i * line) + " ");
+			creator.addFile("file" + std::to_string(i), data);
+			files.push_back(data);
+		}
+		std::size_t total = 0;
+		for (auto& data : files) total += data->length();
+		std::vector<std::string> archives;
+		for (std::size_t threads : { 1, 4 }) {
+			const fs::path archive = dir / ("threads" + std::to_string(threads) + ".rpk");
+			rvn::CreateOptions options;
+			options.compression.codec = RPK_CODEC_LZ4;
+			options.threads = threads;
+			CHECK(rvn::package::createArchive(creator, archive.string(), options, true) == RPK_OK);
+			archives.push_back(readFile(archive));
+			rvn::ArchiveReader reader;
+			CHECK(reader.open(archive.string()) == RPK_OK);
+			for (std::size_t i = 0; i < files.size(); i++) {
+				auto result = reader.extractToString("file" + std::to_string(i));
+				CHECK(result.first == RPK_OK && *result.second == *files[i]);
+			}
+		}
+		// The layout doesn't depend on the thread count
+		CHECK(archives[0] == archives[1] && archives[0].length() < total);
+		return true;
+	}
+
+	bool corruptExtractionLeavesNoFile(const fs::path& dir)
+	{
+		// Several chunks, so a compressed file would have written its first chunks before the checksum is known
+		auto data = std::make_shared<std::string>();
+		for (std::size_t i = 0; data->length() < 3 * RPK_COMPRESSION_CHUNK_SIZE; i++) data->append("payload " + std::to_string(i) + "\n");
+		data->resize(3 * RPK_COMPRESSION_CHUNK_SIZE);
+		for (std::uint8_t codec : { RPK_CODEC_NONE, RPK_CODEC_LZ4 }) {
+			const fs::path archive = dir / ("codec" + std::to_string(codec) + ".rpk");
+			const fs::path target = dir / ("codec" + std::to_string(codec) + ".txt");
+			rvn::package::PackageCreator creator;
+			creator.addFile("file.txt", data);
+			rvn::CreateOptions options;
+			options.compression.codec = codec;
+			CHECK(rvn::package::createArchive(creator, archive.string(), options, true) == RPK_OK);
+			// The stored payload of the last chunk, checked before anything of it is decoded
+			CHECK(corrupt(archive, codec == RPK_CODEC_NONE ? getFirstPayload() + 100 : fs::file_size(archive) - 4096));
+
+			const int status = rvn::package::extractFile(archive.string(), "file.txt", target.string());
+			CHECK(status != RPK_OK);
+			if (codec == RPK_CODEC_NONE) CHECK(status == RPK_CHECKSUM_MISMATCH);
+			CHECK(!fs::exists(target));
+			CHECK(!fs::exists(target.string() + ".part"));
+
+			rvn::ArchiveReader reader;
+			CHECK(reader.open(archive.string()) == RPK_OK);
+			std::vector<rvn::ExtractResult> results = reader.extractDirectory("", (dir / ("batch" + std::to_string(codec))).string());
+			CHECK(results.size() == 1 && results[0].status != RPK_OK);
+			CHECK(!fs::exists(results[0].targetPath));
+
+			// The failed extraction doesn't block the target, without verification the damaged file comes out
+			if (codec == RPK_CODEC_NONE) {
+				reader.setVerifyChecksums(false);
+				CHECK(reader.extractFile("file.txt", target.string()) == RPK_OK);
+			}
+		}
+		return true;
+	}
+
+	bool extractKeepsOtherFiles(const fs::path& dir)
+	{
+		rvn::package::PackageCreator creator;
+		// foo.part first, its extraction must not be replaced or removed by the one of foo
+		creator.addFile("foo.part", std::make_shared<std::string>("part"));
+		creator.addFile("foo", std::make_shared<std::string>("foo"));
+		const fs::path archive = dir / "names.rpk";
+		CHECK(rvn::package::createArchive(creator, archive.string(), true) == RPK_OK);
+		rvn::ArchiveReader reader;
+		CHECK(reader.open(archive.string()) == RPK_OK);
+		for (std::size_t threads : { 1, 4 }) {
+			const fs::path target = dir / ("out" + std::to_string(threads));
+			std::vector<rvn::ExtractResult> results = reader.extractDirectory("", target.string(), threads);
+			CHECK(results.size() == 2 && results[0].status == RPK_OK && results[1].status == RPK_OK);
+			CHECK(readFile(target / "foo.part") == "part");
+			CHECK(readFile(target / "foo") == "foo");
+		}
+
+		// Files next to the target that look like temporary files stay as they are
+		const fs::path work = dir / "work";
+		fs::create_directories(work);
+		std::ofstream(work / "user.part", std::ios::binary) << "mine";
+		std::ofstream(work / "taken", std::ios::binary) << "mine";
+		CHECK(reader.extractFile("foo", (work / "user").string()) == RPK_OK);
+		CHECK(reader.extractFile("foo", (work / "taken").string()) == RPK_OUTPUT_EXISTS);
+		CHECK(readFile(work / "user.part") == "mine");
+		CHECK(readFile(work / "taken") == "mine");
+		CHECK(readFile(work / "user") == "foo");
+		CHECK(!hasTempFiles(dir));
+		return true;
+	}
+
+	bool writerErrors(const fs::path& dir)
+	{
+		// Opens fine and has a size on Linux, but every read fails
+		const fs::path unreadable = dir / "unreadable";
+		fs::create_directories(unreadable);
+		rvn::platform::File file;
+		if (file.openRead(unreadable.string()) && file.getSize() > 0) {
+			std::vector<char> streamed;
+			rvn::ArchiveWriter writer(streamed);
+			CHECK(writer.addFile("a.txt", unreadable.string()) == RPK_COULDNT_OPEN_FILE);
+		}
+		std::ofstream(dir / "file.txt", std::ios::binary) << "data";
+		std::vector<char> streamed;
+		rvn::ArchiveWriter writer(streamed);
+		CHECK(writer.addFile("a.txt", (dir / "file.txt").string()) == RPK_OK);
+		CHECK(writer.finish() == RPK_OK);
+		// Nothing can be added to a finished archive, it would never make it into the directory
+		const std::size_t length = streamed.size();
+		CHECK(writer.addFile("b.txt", "x", 1) == RPK_INVALID_OPTIONS);
+		CHECK(writer.addDeletion("c.txt") == RPK_INVALID_OPTIONS);
+		CHECK(writer.finish() == RPK_OK && streamed.size() == length);
+		return true;
+	}
+
+	bool globPatterns(const fs::path& dir)
+	{
+		CHECK(rvn::matchGlob("a/*.png", "a/b.png"));
+		CHECK(!rvn::matchGlob("a/*.png", "a/b/c.png"));
+		CHECK(rvn::matchGlob("a/**/*.png", "a/b.png"));
+		CHECK(rvn::matchGlob("a/**/*.png", "a/b/c/d.png"));
+		CHECK(rvn::matchGlob("**", "a/b"));
+		CHECK(rvn::matchGlob("a/?.txt", "a/b.txt"));
+		CHECK(!rvn::matchGlob("a?b", "a/b"));
+		CHECK(rvn::matchGlob("*a*b*c", "xaybzc"));
+		CHECK(!rvn::matchGlob("*a*b*c", "xay/bzc"));
+		CHECK(rvn::matchGlob("**a**b", "x/a/y/b"));
+
+		// Every wildcard would retry every length with backtracking, this used to take longer than the universe
+		std::string path;
+		for (std::size_t i = 0; i < 100; i++) path += std::string(40, 'a') + "/";
+		path += std::string(40, 'a');
+		const std::string pattern = "**a**a**a**a**a**a**a**a**a**a**a**a**b";
+		const auto begin = std::chrono::steady_clock::now();
+		CHECK(!rvn::matchGlob(pattern, path));
+		CHECK(!rvn::matchGlob("*a*a*a*a*a*a*a*a*a*a*a*a*b", std::string(4000, 'a')));
+		CHECK(rvn::matchGlob(pattern, path + "b"));
+		CHECK(std::chrono::steady_clock::now() - begin < std::chrono::seconds(1));
+
+		// The same through an archive query
+		rvn::package::PackageCreator creator;
+		creator.addFile(path, std::make_shared<std::string>("x"));
+		creator.addFile("b", std::make_shared<std::string>("y"));
+		const fs::path archive = dir / "glob.rpk";
+		CHECK(rvn::package::createArchive(creator, archive.string(), true) == RPK_OK);
+		rvn::ArchiveReader reader;
+		CHECK(reader.open(archive.string()) == RPK_OK);
+		CHECK(reader.query(pattern).getPaths().empty());
+		// Every directory on the way has the same name as the file
+		const std::vector<std::string> matches = reader.query("**/" + std::string(40, 'a')).getPaths();
+		CHECK(matches.size() == 101 && std::count(matches.begin(), matches.end(), path) == 1);
+		return true;
+	}
+
+	std::vector<Test> getTests()
+	{
+		return {
+			{ "compactKeepsOtherFiles", compactKeepsOtherFiles },
+			{ "compressedLayout", compressedLayout },
+			{ "corruptExtractionLeavesNoFile", corruptExtractionLeavesNoFile },
+			{ "extractKeepsOtherFiles", extractKeepsOtherFiles },
+			{ "globPatterns", globPatterns },
+			{ "pathsStayInTarget", pathsStayInTarget },
+			{ "writerErrors", writerErrors }
+		};
+	}
+}
+
+int main(int argc, char** argv) {
+	using namespace tests;
+	const fs::path workDir = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "ravenpackagetests";
+	int failures = 0;
+	for (auto& test : getTests()) {
+		if (argc > 2 && strcmp(argv[2], test.name)) continue;
+		const fs::path dir = workDir / test.name;
+		fs::remove_all(dir);
+		fs::create_directories(dir);
+		const bool passed = test.run(dir);
+		std::cout << (passed ? "PASSED " : "FAILED ") << test.name << std::endl;
+		if (!passed) failures++;
+		else fs::remove_all(dir);
+	}
+	return failures;
+}
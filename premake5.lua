@@ -18,6 +18,8 @@ outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 IncludeDir = {}
 
 include "RavenPackage"
+include "RavenPackageBenchmark"
+include "RavenPackageTests"
 
 project "RavenPackageExecutable"
 	location "RavenPackageExecutable"
@@ -42,6 +44,8 @@ project "RavenPackageExecutable"
 	{
 		"RavenPackage"
 	}
+	filter "system:linux"
+		links "pthread"
 	filter "system:windows"
 		systemversion "latest"
 	filter "configurations:Debug"